@@ -1,7 +1,10 @@
 #include <stdio.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "config.h"
 #include <getopt.h>
 #include <pthread.h>
@@ -17,12 +20,81 @@ usage(FILE *out,const char *name){
 	fprintf(out,"\n");
 	fprintf(out,"usage: rapt-show-versions [ options ] packageregex\n");
 	fprintf(out,"options:\n");
-	fprintf(out," -s|--status-file=<file> Status file (def: %s)\n",raptorial_def_status_file());
+	fprintf(out," -s|--status-file=<file> Status file, - for stdin (def: %s)\n",raptorial_def_status_file());
 	fprintf(out," -l|--list-dir=<dir>     List directory (def: %s)\n",raptorial_def_lists_dir());
 	fprintf(out," -a|--allversions        Print all available versions\n");
+	fprintf(out," -p|--pipeline=<mode>    Lex lists alongside status: off (def), on, auto\n");
+	fprintf(out,"                         (unfiltered: faster given idle CPUs, but costs more\n");
+	fprintf(out,"                          memory and CPU; auto is on with more than one CPU)\n");
+	fprintf(out," -i|--io=<strategy>      List I/O: populate (def), lazy, hugepage, pread, uring\n");
+	fprintf(out," -m|--mem-budget=<size>  Bound list memory (K/M/G suffixes, def: 0 == none)\n");
+	fprintf(out," -t|--threads=<count>    Lex on a pool of this many threads (def: one per CPU)\n");
 	fprintf(out," -h|--help               Display this usage summary\n");
 }
 
+static const struct {
+	const char *name;
+	raptorial_io io;
+} iostrategies[] = {
+	{ "populate", RAPTORIAL_IO_POPULATE, },
+	{ "lazy", RAPTORIAL_IO_LAZY, },
+	{ "hugepage", RAPTORIAL_IO_HUGEPAGE, },
+	{ "pread", RAPTORIAL_IO_PREAD, },
+	{ "uring", RAPTORIAL_IO_URING, },
+	{ NULL, 0, },
+};
+
+static int
+parse_io(const char *name,raptorial_io *io){
+	unsigned z;
+
+	for(z = 0 ; iostrategies[z].name ; ++z){
+		if(strcmp(iostrategies[z].name,name) == 0){
+			*io = iostrategies[z].io;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+// A byte count, optionally suffixed with K, M or G.
+static int
+parse_size(const char *str,size_t *size){
+	unsigned long long ull;
+	char *end;
+
+	errno = 0;
+	ull = strtoull(str,&end,0);
+	if(errno || end == str || *str == '-'){
+		return -1;
+	}
+	switch(*end){
+		case 'G': case 'g': ull <<= 10; // fallthrough
+		case 'M': case 'm': ull <<= 10; // fallthrough
+		case 'K': case 'k': ull <<= 10; ++end; break;
+	}
+	if(*end || ull > SIZE_MAX){
+		return -1;
+	}
+	*size = ull;
+	return 0;
+}
+
+// A positive thread count.
+static int
+parse_threads(const char *str,unsigned *threads){
+	unsigned long ul;
+	char *end;
+
+	errno = 0;
+	ul = strtoul(str,&end,10);
+	if(errno || end == str || *end || *str == '-' || ul == 0 || ul > UINT_MAX){
+		return -1;
+	}
+	*threads = ul;
+	return 0;
+}
+
 struct focmarsh {
 	const struct dfa *dfa;
 	const struct pkgcache *pc;
@@ -102,6 +174,23 @@ installed_output(const struct dfa *dfa,const struct pkgcache *pc,const struct pk
 	return walk_dfa(dfa,filtered_output_callback,&foc);
 }
 
+// The package lists are lexed on their own thread, unfiltered but indexed by
+// name, while the status file is lexed, and attached to its packages after.
+struct listmarsh {
+	const char *listdir;
+	const raptorial_lexopts *opts;
+	struct pkgcache *pc;
+	int err;
+};
+
+static void *
+lex_lists_thread(void *vlm){
+	struct listmarsh *lm = vlm;
+
+	lm->pc = lex_packages_dir_opts(lm->listdir,&lm->err,NULL,lm->opts);
+	return NULL;
+}
+
 // There's no need to free up the structures on exit -- the OS reclaims that
 // memory. If this code is embedded elsewhere, however, make use of
 // free_package_list() and free_package_cache() as appropriate.
@@ -110,19 +199,28 @@ int main(int argc,char **argv){
 		{ "status-file", 1, NULL, 's' },
 		{ "list-dir", 1, NULL, 'l' },
 		{ "allversions", 0, NULL, 'a' },
+		{ "pipeline", 1, NULL, 'p' },
+		{ "io", 1, NULL, 'i' },
+		{ "mem-budget", 1, NULL, 'm' },
+		{ "threads", 1, NULL, 't' },
 		{ "help", 0, NULL, 'h' },
 		{ NULL, 0, NULL, 0 }
 	};
 	const char *statusfile,*listdir;
+	raptorial_lexopts opts = { .flags = 0, };
+	raptorial_lexopts statopts = { .flags = 0, };
+	raptorial_poolopts popts = { .threads = 0, };
+	struct listmarsh lm;
 	struct pkglist *stat;
-	int allversions = 0;
+	pthread_t tid;
+	int allversions = 0,pipeline = 0;
 	struct pkgcache *pc;
 	struct dfa *dfa;
 	int err,c;
 
 	listdir = NULL;
 	statusfile = NULL;
-	while((c = getopt_long(argc,argv,"s:l:ah",longopts,&optind)) != -1){
+	while((c = getopt_long(argc,argv,"s:l:ap:i:m:t:h",longopts,&optind)) != -1){
 		switch(c){
 			case 'h':
 				usage(stdout,argv[0]);
@@ -130,6 +228,19 @@ int main(int argc,char **argv){
 			case 'a':
 				allversions = 1;
 				break;
+			case 'p':
+				if(strcmp(optarg,"on") == 0){
+					pipeline = 1;
+				}else if(strcmp(optarg,"off") == 0){
+					pipeline = 0;
+				}else if(strcmp(optarg,"auto") == 0){
+					pipeline = -1;
+				}else{
+					fprintf(stderr,"Unknown pipeline mode: %s\n",optarg);
+					usage(stderr,argv[0]);
+					return EXIT_FAILURE;
+				}
+				break;
 			case 'l':
 				if(listdir){
 					fprintf(stderr,"Provided listdir twice.\n");
@@ -137,6 +248,27 @@ int main(int argc,char **argv){
 				}
 				listdir = optarg;
 				break;
+			case 'i':
+				if(parse_io(optarg,&opts.io)){
+					fprintf(stderr,"Unknown I/O strategy: %s\n",optarg);
+					usage(stderr,argv[0]);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'm':
+				if(parse_size(optarg,&opts.membudget)){
+					fprintf(stderr,"Invalid memory budget: %s\n",optarg);
+					usage(stderr,argv[0]);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 't':
+				if(parse_threads(optarg,&popts.threads)){
+					fprintf(stderr,"Invalid thread count: %s\n",optarg);
+					usage(stderr,argv[0]);
+					return EXIT_FAILURE;
+				}
+				break;
 			case 's':
 				if(statusfile){
 					fprintf(stderr,"Provided status file twice.\n");
@@ -156,8 +288,11 @@ int main(int argc,char **argv){
 			return EXIT_FAILURE;
 		}
 	}
+	// apt's own lists are checked against its sources, so that lists
+	// left behind by removed sources aren't reported.
 	if(listdir == NULL){
 		listdir = raptorial_def_lists_dir();
+		opts.sources = raptorial_def_sources_list();
 	}
 	statusfile = statusfile;
 	dfa = NULL;
@@ -176,17 +311,60 @@ int main(int argc,char **argv){
 		}
 		++argv;
 	}
-	// We used to parallelize status file reading against the (already
-	// parallel) package list reading. We no longer do so, since we
-	// generate the filtering DFA based off the status file, and would
-	// otherwise need gross locking.
-	if((stat = lex_status_file(statusfile,&err,&dfa)) == NULL){
+	// The filtering DFA is built from the status file, so the lists can't
+	// be filtered as they're lexed without waiting on it. When pipelining,
+	// they're instead lexed in full alongside the status file, and joined
+	// afterwards. That's more total work and memory than filtering, and only
+	// pays when there's a spare processor to overlap it on, so it's off by
+	// default; auto turns it on whenever there might be.
+	if(pipeline < 0){
+		pipeline = popts.threads ? popts.threads > 1 :
+				sysconf(_SC_NPROCESSORS_ONLN) > 1;
+	}
+	// Both the lists and the status file are lexed on the one pool.
+	if(popts.threads){
+		if((opts.pool = raptorial_pool_create(&popts,&err)) == NULL){
+			fprintf(stderr,"Couldn't create thread pool (%s?)\n",strerror(err));
+			return EXIT_FAILURE;
+		}
+		statopts.pool = opts.pool;
+	}
+	if(pipeline){
+		opts.flags |= RAPTORIAL_LEX_INDEX;
+		lm.listdir = listdir;
+		lm.opts = &opts;
+		if( (err = pthread_create(&tid,NULL,lex_lists_thread,&lm)) ){
+			fprintf(stderr,"Couldn't launch list lexer (%s?)\n",strerror(err));
+			return EXIT_FAILURE;
+		}
+	}
+	if(strcmp(statusfile,"-") == 0){
+		stat = lex_status_fd_opts(STDIN_FILENO,&err,&dfa,&statopts);
+	}else{
+		stat = lex_status_file_opts(statusfile,&err,&dfa,&statopts);
+	}
+	if(stat == NULL){
 		fprintf(stderr,"Couldn't parse %s (%s?)\n",
 			statusfile,strerror(err));
 		return EXIT_FAILURE;
 	}
+	if(pipeline){
+		if( (err = pthread_join(tid,NULL)) ){
+			fprintf(stderr,"Couldn't join list lexer (%s?)\n",strerror(err));
+			return EXIT_FAILURE;
+		}
+		if((pc = lm.pc) == NULL){
+			fprintf(stderr,"Couldn't parse %s (%s?)\n",listdir,strerror(lm.err));
+			return EXIT_FAILURE;
+		}
+	}
 	if(dfa){ // otherwise, no packages installed and none listed
-		if((pc = lex_packages_dir(listdir,&err,dfa)) == NULL){
+		if(pipeline){
+			if(pkgcache_attach(pc,dfa,&err)){
+				fprintf(stderr,"Couldn't attach %s (%s?)\n",listdir,strerror(err));
+				return EXIT_FAILURE;
+			}
+		}else if((pc = lex_packages_dir_opts(listdir,&err,dfa,&opts)) == NULL){
 			fprintf(stderr,"Couldn't parse %s (%s?)\n",listdir,strerror(err));
 			return EXIT_FAILURE;
 		}
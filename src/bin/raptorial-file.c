@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <paths.h>
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <getopt.h>
 #include "config.h"
@@ -19,6 +21,7 @@ usage(const char *name,int retcode){
 	fprintf(fp, "\t-c/--cache cachedir: content files directory\n");
 	fprintf(fp, "\t\t(%s by default)\n", raptorial_def_content_dir());
 	fprintf(fp, "\t-i/--ignore-case: case-insensitive matching\n");
+	fprintf(fp, "\t-t/--threads count: lex on a pool of count threads\n");
 	fprintf(fp, "\t-h/--help: this output\n");
 	exit(retcode);
 }
@@ -37,21 +40,39 @@ lowercase(const char *s){
 	return ret;
 }
 
+// A positive thread count.
+static int
+parse_threads(const char *str,unsigned *threads){
+	unsigned long ul;
+	char *end;
+
+	errno = 0;
+	ul = strtoul(str,&end,10);
+	if(errno || end == str || *end || *str == '-' || ul == 0 || ul > UINT_MAX){
+		return -1;
+	}
+	*threads = ul;
+	return 0;
+}
+
 int main(int argc,char **argv){
 	const struct option longopts[] = {
 		{ "cache", 1, NULL, 'c' },
 		{ "from-deb", 0, NULL, 'D' },
 		{ "from-file", 1, NULL, 'f' },
 		{ "ignore-case", 0, NULL, 'i' },
+		{ "threads", 1, NULL, 't' },
 		{ "verbose", 0, NULL, 'v' },
     { "help", 0, NULL, 'h' },
     { NULL, 0, NULL, 0 }
   };
+	raptorial_poolopts popts = { .threads = 0, };
+	raptorial_lexopts opts = { .flags = 0, };
 	const char *cdir = NULL;
 	int c,err,nocase = 0;
 	struct dfa *dfa;
 
-	while((c = getopt_long(argc,argv,"hic:Df:v",longopts,&optind)) != -1){
+	while((c = getopt_long(argc,argv,"hic:Df:t:v",longopts,&optind)) != -1){
 		switch(c){
 		case 'c':
 			if(cdir){
@@ -69,6 +90,17 @@ int main(int argc,char **argv){
 			}
 			nocase = 1;
 			break;
+		case 't':
+			if(popts.threads){
+				fprintf(stderr,"Provided -t/--threads twice, exiting\n");
+				usage(argv[0],EXIT_FAILURE);
+				break;
+			}
+			if(parse_threads(optarg,&popts.threads)){
+				fprintf(stderr,"Invalid thread count: %s\n",optarg);
+				usage(argv[0],EXIT_FAILURE);
+			}
+			break;
 		case 'D': // FIXME implement
 		case 'f': // FIXME implement
 		case 'v':
@@ -113,7 +145,13 @@ int main(int argc,char **argv){
 		free(s);
                 ++optind;
 	}while(argv[optind]);
-	if(lex_contents_dir(cdir,&err,dfa,nocase)){
+	if(popts.threads){
+		if((opts.pool = raptorial_pool_create(&popts,&err)) == NULL){
+			fprintf(stderr,"Couldn't create thread pool (%s?)\n",strerror(err));
+			return EXIT_FAILURE;
+		}
+	}
+	if(lex_contents_dir_opts(cdir,&err,dfa,nocase,&opts)){
 		fprintf(stderr,"Error matching contents files (%s?)\n",strerror(err));
 		return EXIT_FAILURE;
 	}
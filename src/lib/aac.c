@@ -129,13 +129,13 @@ make_delta2(int *delta2, const unsigned char *pat, int32_t patlen) {
 }
 
 static int
-bmgprepare(bmgstate *bmg,const char *str,void *val){
+bmgprepare(bmgstate *bmg,const char *str,size_t len,void *val){
 	unsigned z;
 
-	if((bmg->match = (unsigned char *)strdup(str)) == NULL){
+	if((bmg->match = (unsigned char *)strndup(str,len)) == NULL){
 		return -1;
 	}
-	bmg->len = strlen(str);
+	bmg->len = len;
 	if((bmg->delta2 = malloc(bmg->len * sizeof(*bmg->delta2))) == NULL){
 		free(bmg->match);
 		return -1;
@@ -153,6 +153,10 @@ bmgprepare(bmgstate *bmg,const char *str,void *val){
 
 PUBLIC int
 augment_dfa(dfa **space,const char *str,void *val){
+	return augment_dfa_nstring(space,str,strlen(str),val);
+}
+
+int augment_dfa_nstring(dfa **space,const char *str,size_t len,void *val){
 	const char *s;
 	dfavtx *cur;
 
@@ -183,7 +187,7 @@ augment_dfa(dfa **space,const char *str,void *val){
 	// the list sorted. This phase is thus nlg(e) (n characters X lg(e)
 	// edge searches). We can't use bsearch(3) because it doesn't provide
 	// the position where the value ought have been on failure.
-	for(cur = (*space)->vtxarray, s = str ; *s ; ++s){
+	for(cur = (*space)->vtxarray, s = str ; s < str + len ; ++s){
 		unsigned pos;
 
 		pos = edge_search(cur,*s);
@@ -227,7 +231,7 @@ augment_dfa(dfa **space,const char *str,void *val){
 		(*space)->longest = s - str;
 	}
 	if(++(*space)->patcount == 1){
-		bmgprepare(&(*space)->bmg,str,val);
+		bmgprepare(&(*space)->bmg,str,len,val);
 	}else if((*space)->bmg.match){
 		free((*space)->bmg.match);
 		(*space)->bmg.match = NULL;
@@ -347,7 +351,7 @@ recurse_dfa(const dfa *d,const dfavtx *dvtx,char *str,unsigned stroff,
 int walk_dfa(const dfa *d,int (*cb)(const char *,const void *,const void *),
 					const void *opaq){
 	if(d){ // New DFAs get longest = 1, so needn't check that
-		char str[d->longest];
+		char str[d->longest + 1];
 
 		return recurse_dfa(d,d->vtxarray,str,0,cb,opaq);
 	}
@@ -16,6 +16,7 @@ free_dfactx(dfactx *dctx){
 	free(dctx);
 }
 
+int augment_dfa_nstring(struct dfa **,const char *,size_t,void *);
 void *match_dfactx_string(dfactx *,const char *);
 void *match_dfactx_nstring(dfactx *,const char *,size_t);
 void *match_dfactx_against_nstring(dfactx *,const char *,size_t);
@@ -0,0 +1,51 @@
+#include <arena.h>
+#include <stdlib.h>
+
+// Large enough that block allocation vanishes from the profile, small enough
+// that the partially-used final block of each chunk's arena doesn't matter.
+#define ARENA_BLOCK (32 * 1024)
+
+void *arena_alloc(arena *ar,size_t len){
+  const size_t align = sizeof(max_align_t);
+  arenablock *ab;
+  void *ret;
+
+  len = (len + align - 1) / align * align;
+  if((ab = ar->blocks) == NULL || ab->size - ab->used < len){
+    size_t size = len > ARENA_BLOCK ? len : ARENA_BLOCK;
+
+    if((ab = malloc(sizeof(*ab) + size)) == NULL){
+      return NULL;
+    }
+    ab->used = 0;
+    ab->size = size;
+    if((ab->next = ar->blocks) == NULL){
+      ar->tail = &ab->next;
+    }
+    ar->blocks = ab;
+  }
+  ret = (char *)ab->data + ab->used;
+  ab->used += len;
+  return ret;
+}
+
+void arena_splice(arena *dst,arena *src){
+  if(src->blocks){
+    *src->tail = dst->blocks;
+    if(dst->blocks == NULL){
+      dst->tail = src->tail;
+    }
+    dst->blocks = src->blocks;
+    arena_init(src);
+  }
+}
+
+void arena_free(arena *ar){
+  arenablock *ab;
+
+  while( (ab = ar->blocks) ){
+    ar->blocks = ab->next;
+    free(ab);
+  }
+  arena_init(ar);
+}
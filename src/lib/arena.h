@@ -0,0 +1,34 @@
+#ifndef RAPTORIAL_ARENA
+#define RAPTORIAL_ARENA
+
+// private bump allocation for raptorial
+#include <stddef.h>
+
+// An arena hands out memory by bumping a pointer through blocks, and frees
+// it all at once. It is not thread-safe; each chunk task lexes into its own
+// arena, which is spliced into the list's arena once the chunk succeeds.
+typedef struct arenablock {
+  struct arenablock *next;
+  size_t used,size;
+  max_align_t data[];
+} arenablock;
+
+typedef struct arena {
+  arenablock *blocks; // most recent first; allocations come from the head
+  arenablock **tail;  // for O(1) splicing
+} arena;
+
+static inline void
+arena_init(arena *ar){
+  ar->blocks = NULL;
+  ar->tail = &ar->blocks;
+}
+
+void *arena_alloc(arena *,size_t);
+
+// Move all of src's blocks into dst, leaving src empty.
+void arena_splice(arena *dst,arena *src);
+
+void arena_free(arena *);
+
+#endif
@@ -301,7 +301,7 @@ const changelog *lex_changelog(const char *fn,int *err,const changelog **cptr){
 	}else{
 		cptr = &dontcare;
 	}
-	if((map = mapit(fn,&len,&fd,0,err)) == MAP_FAILED){
+	if((map = mapit(AT_FDCWD,fn,&len,&fd,RAPTORIAL_IO_POPULATE,err)) == MAP_FAILED){
 		return NULL;
 	}
 	if((cl = lex_changelog_map(map,len,cptr)) == NULL){
@@ -11,8 +11,8 @@
 #include <unistd.h>
 #include <assert.h>
 #include <pthread.h>
-#include <blossom.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 static void *
@@ -121,6 +121,7 @@ typedef struct workmonad {
 // semaphore, and checking for newly posted work, can they exit.
 struct dirparse {
   DIR *dir;
+  int dirfd; // the dir's, against which its entries are opened
   int nocase;
   const struct dfa *dfa;
 
@@ -269,7 +270,7 @@ lex_packages_file_internal(const char *path,struct dirparse *dp,void *infbuf,
   if(path == NULL){
     return -1;
   }
-  if((map = mapit(path,&mlen,&fd,1,&err)) == MAP_FAILED){
+  if((map = mapit(dp->dirfd,path,&mlen,&fd,RAPTORIAL_IO_POPULATE,&err)) == MAP_FAILED){
     return -1;
   }
   if(lex_content_map_oneshot(map,mlen,dp,infbuf,buflen)){
@@ -354,21 +355,43 @@ lex_dir(void *vdp){
   return dp;
 }
 
+// The bytes of the directory's Contents files, which are then rewound.
+static size_t
+contents_bytes(DIR *dir){
+  struct dirent *pdent;
+  size_t bytes = 0;
+  struct stat st;
+
+  while( (pdent = readdir(dir)) ){
+    const char *ext;
+
+    if(pdent->d_type != DT_REG && pdent->d_type != DT_LNK){
+      continue;
+    }
+    if((ext = strrchr(pdent->d_name,'.')) == NULL || strcmp(ext,".gz")){
+      continue;
+    }
+    if(fstatat(dirfd(dir),pdent->d_name,&st,0) == 0){
+      bytes += st.st_size;
+    }
+  }
+  rewinddir(dir);
+  return bytes;
+}
+
 // len is the true length, less than or equal to the mapped length.
 static int
-lex_listdir(DIR *dir,int *err,struct dfa *dfa,int nocase){
+lex_listdir(DIR *dir,int *err,struct dfa *dfa,int nocase,
+            struct raptorial_pool *rp){
   struct dirparse dp = {
     .dir = dir,
+    .dirfd = dirfd(dir),
     .dfa = dfa,
     .queue = NULL,
     .holdup_sem = 0,
     .nocase = nocase,
   };
-  blossom_ctl bctl = {
-    .flags = 0,
-    .tids = 1,
-  };
-  blossom_state bs;
+  unsigned threads;
   int r;
 
   if( (r = pthread_mutex_init(&dp.lock,NULL)) ){
@@ -380,48 +403,26 @@ lex_listdir(DIR *dir,int *err,struct dfa *dfa,int nocase){
     pthread_mutex_destroy(&dp.lock);
     return -1;
   }
-  if(blossom_per_pe(&bctl,&bs,NULL,lex_dir,&dp)){
-    *err = errno;
-    pthread_mutex_destroy(&dp.lock);
-    pthread_cond_destroy(&dp.cond);
-    return -1;
-  }
-  if(blossom_join_all(&bs)){
-    *err = errno;
-    blossom_free_state(&bs);
-    pthread_mutex_destroy(&dp.lock);
-    pthread_cond_destroy(&dp.cond);
-    return -1;
-  }
-  if(blossom_validate_joinrets(&bs)){
-    blossom_free_state(&bs);
-    pthread_mutex_destroy(&dp.lock);
-    pthread_cond_destroy(&dp.cond);
-    return -1;
-  }
-  blossom_free_state(&bs);
+  // A few small Contents files are lexed inline, without threads.
+  threads = threads_for_bytes(rp,contents_bytes(dir) * COMP_RATIO);
+  r = run_threads(rp,threads,lex_dir,&dp,err);
   pthread_mutex_destroy(&dp.lock);
   pthread_cond_destroy(&dp.cond);
-  return 0;
+  return r;
 }
 
 // If dfa is non-NULL, it will be used to filter our list. This function is
 // not capable of building a DFA.
 PUBLIC int
-lex_contents_dir(const char *dir,int *err,struct dfa *dfa,int nocase){
+lex_contents_dir_opts(const char *dir,int *err,struct dfa *dfa,int nocase,
+                      const raptorial_lexopts *opts){
   DIR *d;
 
   if((d = opendir(dir)) == NULL){
     *err = errno;
     return -1;
   }
-  // Change directory so that relative dent.d_name entries can be opened
-  if(chdir(dir)){
-    *err = errno;
-    closedir(d);
-    return -1;
-  }
-  if(lex_listdir(d,err,dfa,nocase)){
+  if(lex_listdir(d,err,dfa,nocase,opts ? opts->pool : NULL)){
     closedir(d);
     return -1;
   }
@@ -430,3 +431,8 @@ lex_contents_dir(const char *dir,int *err,struct dfa *dfa,int nocase){
   }
   return 0;
 }
+
+PUBLIC int
+lex_contents_dir(const char *dir,int *err,struct dfa *dfa,int nocase){
+  return lex_contents_dir_opts(dir,err,dfa,nocase,NULL);
+}
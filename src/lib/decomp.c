@@ -0,0 +1,263 @@
+#include <decomp.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <stdint.h>
+
+static const struct {
+  const char *suffix;
+  compkind kind;
+} suffixes[] = {
+  { ".gz", COMP_GZIP, },
+#ifdef HAVE_LZMA
+  { ".xz", COMP_XZ, },
+#else
+  { ".xz", COMP_UNSUPPORTED, },
+#endif
+#ifdef HAVE_LZ4
+  { ".lz4", COMP_LZ4, },
+#else
+  { ".lz4", COMP_UNSUPPORTED, },
+#endif
+#ifdef HAVE_ZSTD
+  { ".zst", COMP_ZSTD, },
+#else
+  { ".zst", COMP_UNSUPPORTED, },
+#endif
+  { ".bz2", COMP_UNSUPPORTED, },
+  { ".lzma", COMP_UNSUPPORTED, },
+  { NULL, COMP_NONE, },
+};
+
+compkind comp_from_name(const char *name,size_t *sufflen){
+  size_t len = strlen(name);
+  unsigned z;
+
+  for(z = 0 ; suffixes[z].suffix ; ++z){
+    size_t slen = strlen(suffixes[z].suffix);
+
+    if(len > slen && strcmp(name + len - slen,suffixes[z].suffix) == 0){
+      *sufflen = slen;
+      return suffixes[z].kind;
+    }
+  }
+  *sufflen = 0;
+  return COMP_NONE;
+}
+
+int decomp_init(decomp *dc,compkind kind,const void *in,size_t inlen){
+  memset(dc,0,sizeof(*dc));
+  dc->kind = kind;
+  dc->in = in;
+  dc->inlen = inlen;
+  dc->hint = 1;
+  switch(kind){
+  case COMP_GZIP:
+    // 15 bits of window, +32 to autodetect zlib or gzip headers
+    if(inflateInit2(&dc->u.z,15 + 32) != Z_OK){
+      return ENOMEM;
+    }
+    return 0;
+#ifdef HAVE_LZMA
+  case COMP_XZ:{
+    lzma_stream x = LZMA_STREAM_INIT;
+
+    dc->u.x = x;
+    if(lzma_stream_decoder(&dc->u.x,UINT64_MAX,LZMA_CONCATENATED) != LZMA_OK){
+      return ENOMEM;
+    }
+    dc->u.x.next_in = dc->in;
+    dc->u.x.avail_in = dc->inlen;
+    return 0;
+  }
+#endif
+#ifdef HAVE_LZ4
+  case COMP_LZ4:
+    if(LZ4F_isError(LZ4F_createDecompressionContext(&dc->u.l,LZ4F_VERSION))){
+      return ENOMEM;
+    }
+    return 0;
+#endif
+#ifdef HAVE_ZSTD
+  case COMP_ZSTD:
+    if((dc->u.zs = ZSTD_createDStream()) == NULL){
+      return ENOMEM;
+    }
+    if(ZSTD_isError(ZSTD_initDStream(dc->u.zs))){
+      ZSTD_freeDStream(dc->u.zs);
+      return ENOMEM;
+    }
+    return 0;
+#endif
+  default:
+    return ENOTSUP;
+  }
+}
+
+// zlib's counts are unsigned ints, so large inputs and outputs are fed to it
+// a piece at a time.
+static int
+read_gzip(decomp *dc,unsigned char *buf,size_t len,size_t *out,int *done){
+  z_stream *z = &dc->u.z;
+  int r;
+
+  while(*out < len){
+    if(z->avail_in == 0){
+      if(dc->inlen == 0){
+        return EINVAL; // truncated
+      }
+      z->next_in = (unsigned char *)dc->in;
+      z->avail_in = dc->inlen > UINT_MAX ? UINT_MAX : dc->inlen;
+      dc->in += z->avail_in;
+      dc->inlen -= z->avail_in;
+    }
+    z->next_out = buf + *out;
+    z->avail_out = len - *out > UINT_MAX ? UINT_MAX : len - *out;
+    r = inflate(z,Z_NO_FLUSH);
+    *out = z->next_out - buf;
+    if(r == Z_STREAM_END){
+      if(z->avail_in == 0 && dc->inlen == 0){
+        *done = 1;
+        return 0;
+      }
+      if(inflateReset(z) != Z_OK){ // another gzip member follows
+        return EINVAL;
+      }
+    }else if(r == Z_MEM_ERROR){
+      return ENOMEM;
+    }else if(r != Z_OK){
+      return EINVAL;
+    }
+  }
+  return 0;
+}
+
+#ifdef HAVE_LZMA
+static int
+read_xz(decomp *dc,unsigned char *buf,size_t len,size_t *out,int *done){
+  lzma_stream *x = &dc->u.x;
+  lzma_ret r;
+
+  x->next_out = buf;
+  x->avail_out = len;
+  // We have all of our input, so we can always be finishing.
+  r = lzma_code(x,LZMA_FINISH);
+  *out = x->next_out - buf;
+  if(r == LZMA_STREAM_END){
+    *done = 1;
+    return 0;
+  }
+  if(r == LZMA_OK){
+    return 0;
+  }
+  return r == LZMA_MEM_ERROR ? ENOMEM : EINVAL;
+}
+#endif
+
+// The frame decoders of lz4 and zstd might hold decoded data internally,
+// so we keep calling them until they're out of input *and* report their
+// frame complete (a hint of 0), or they stop making progress.
+#ifdef HAVE_LZ4
+static int
+read_lz4(decomp *dc,unsigned char *buf,size_t len,size_t *out,int *done){
+  while(*out < len){
+    size_t olen = len - *out,ilen = dc->inlen;
+
+    if(dc->inlen == 0 && dc->hint == 0){
+      *done = 1;
+      break;
+    }
+    dc->hint = LZ4F_decompress(dc->u.l,buf + *out,&olen,dc->in,&ilen,NULL);
+    if(LZ4F_isError(dc->hint)){
+      return EINVAL;
+    }
+    if(olen == 0 && ilen == 0 && dc->hint){
+      return EINVAL; // truncated
+    }
+    *out += olen;
+    dc->in += ilen;
+    dc->inlen -= ilen;
+  }
+  return 0;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static int
+read_zstd(decomp *dc,unsigned char *buf,size_t len,size_t *out,int *done){
+  ZSTD_outBuffer ob = { buf, len, 0, };
+  ZSTD_inBuffer ib = { dc->in, dc->inlen, 0, };
+  int r = 0;
+
+  while(ob.pos < ob.size){
+    size_t opos = ob.pos,ipos = ib.pos;
+
+    if(ib.pos == ib.size && dc->hint == 0){
+      *done = 1;
+      break;
+    }
+    dc->hint = ZSTD_decompressStream(dc->u.zs,&ob,&ib);
+    if(ZSTD_isError(dc->hint)){
+      r = EINVAL;
+      break;
+    }
+    if(ob.pos == opos && ib.pos == ipos && dc->hint){
+      r = EINVAL; // truncated
+      break;
+    }
+  }
+  *out = ob.pos;
+  dc->in += ib.pos;
+  dc->inlen -= ib.pos;
+  return r;
+}
+#endif
+
+int decomp_read(decomp *dc,void *buf,size_t len,size_t *out,int *done){
+  *out = 0;
+  *done = 0;
+  switch(dc->kind){
+  case COMP_GZIP:
+    return read_gzip(dc,buf,len,out,done);
+#ifdef HAVE_LZMA
+  case COMP_XZ:
+    return read_xz(dc,buf,len,out,done);
+#endif
+#ifdef HAVE_LZ4
+  case COMP_LZ4:
+    return read_lz4(dc,buf,len,out,done);
+#endif
+#ifdef HAVE_ZSTD
+  case COMP_ZSTD:
+    return read_zstd(dc,buf,len,out,done);
+#endif
+  default:
+    return ENOTSUP;
+  }
+}
+
+void decomp_end(decomp *dc){
+  switch(dc->kind){
+  case COMP_GZIP:
+    inflateEnd(&dc->u.z);
+    break;
+#ifdef HAVE_LZMA
+  case COMP_XZ:
+    lzma_end(&dc->u.x);
+    break;
+#endif
+#ifdef HAVE_LZ4
+  case COMP_LZ4:
+    LZ4F_freeDecompressionContext(dc->u.l);
+    break;
+#endif
+#ifdef HAVE_ZSTD
+  case COMP_ZSTD:
+    ZSTD_freeDStream(dc->u.zs);
+    break;
+#endif
+  default:
+    break;
+  }
+  dc->kind = COMP_NONE;
+}
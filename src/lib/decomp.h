@@ -0,0 +1,65 @@
+#ifndef RAPTORIAL_DECOMP
+#define RAPTORIAL_DECOMP
+
+// private streaming decompression for raptorial
+#include <config.h>
+#include <zlib.h>
+#include <stddef.h>
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// APT stores lists compressed when configured with Acquire::GzipIndexes or
+// Acquire::CompressionTypes. We support gzip always, and the others when
+// their libraries were found at build time.
+typedef enum {
+  COMP_NONE,
+  COMP_GZIP,
+  COMP_XZ,
+  COMP_LZ4,
+  COMP_ZSTD,
+  COMP_UNSUPPORTED, // a compressed list we weren't built to handle
+} compkind;
+
+// Returns the compression indicated by the filename's suffix, writing the
+// suffix's length through (0 for COMP_NONE).
+compkind comp_from_name(const char *,size_t *);
+
+// Decompresses an in-memory compressed stream (generally, a mapped list).
+// Concatenated streams/frames are decompressed in order, as their tools do.
+typedef struct decomp {
+  compkind kind;
+  const unsigned char *in; // input not yet handed to the decoder
+  size_t inlen;
+  size_t hint; // lz4/zstd: 0 once a frame has been completely decoded
+  union {
+    z_stream z;
+#ifdef HAVE_LZMA
+    lzma_stream x;
+#endif
+#ifdef HAVE_LZ4
+    LZ4F_dctx *l;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zs;
+#endif
+  } u;
+} decomp;
+
+// Returns 0 on success, or an errno value.
+int decomp_init(decomp *,compkind,const void *,size_t);
+
+// Fill the buffer, stopping short only at the end of the input. The number
+// of bytes produced is written through, as is whether the stream is done.
+// Returns 0 on success, or an errno value (EINVAL for corrupt input).
+int decomp_read(decomp *,void *,size_t,size_t *,int *);
+
+void decomp_end(decomp *);
+
+#endif
@@ -0,0 +1,356 @@
+#include <pool.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <nameindex.h>
+
+// Below this many entries, spinning up workers costs more than it saves.
+#define INDEX_PARALLEL_MIN 32768
+
+static inline int
+namecmp(const char *a,size_t alen,const char *b,size_t blen){
+  int r = memcmp(a,b,alen < blen ? alen : blen);
+
+  if(r){
+    return r;
+  }
+  return alen < blen ? -1 : alen > blen;
+}
+
+static int
+nameent_cmp(const void *va,const void *vb){
+  const nameent *a = va,*b = vb;
+
+  return namecmp(a->name,a->len,b->name,b->len);
+}
+
+// FNV-1a
+static inline size_t
+hash_name(const char *name,size_t len){
+  uint64_t h = 14695981039346656037ull;
+
+  while(len--){
+    h ^= (unsigned char)*name++;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+// One unit of the parallel build: sort [lo, hi) of src in place; merge
+// src's sorted [lo, mid) and [mid, hi) into dst; count the names whose first
+// entries lie in [lo, hi); or hash and number those names, beginning with
+// id base.
+struct indextask {
+  nameindex *ni;
+  nameent *src,*dst;
+  size_t lo,mid,hi;
+  size_t base;
+  nameidfxn fxn;
+};
+
+static inline int
+name_starts(const nameent *ents,size_t z){
+  return z == 0 || namecmp(ents[z].name,ents[z].len,ents[z - 1].name,ents[z - 1].len);
+}
+
+static int
+sort_task(workpool *wp __attribute__ ((unused)),void *vit){
+  struct indextask *it = vit;
+
+  qsort(it->src + it->lo,it->hi - it->lo,sizeof(*it->src),nameent_cmp);
+  return 0;
+}
+
+static int
+merge_task(workpool *wp __attribute__ ((unused)),void *vit){
+  struct indextask *it = vit;
+  size_t a = it->lo,b = it->mid,z = it->lo;
+
+  while(a < it->mid && b < it->hi){
+    if(nameent_cmp(&it->src[b],&it->src[a]) < 0){
+      it->dst[z++] = it->src[b++];
+    }else{
+      it->dst[z++] = it->src[a++];
+    }
+  }
+  memcpy(it->dst + z,it->src + a,sizeof(*it->src) * (it->mid - a));
+  z += it->mid - a;
+  memcpy(it->dst + z,it->src + b,sizeof(*it->src) * (it->hi - b));
+  return 0;
+}
+
+static int
+count_task(workpool *wp __attribute__ ((unused)),void *vit){
+  struct indextask *it = vit;
+  size_t z;
+
+  it->base = 0;
+  for(z = it->lo ; z < it->hi ; ++z){
+    it->base += name_starts(it->ni->ents,z);
+  }
+  return 0;
+}
+
+// Distinct names are inserted by distinct tasks, so a claimed slot always
+// belongs to some other name, and we needn't compare against it.
+static int
+hash_task(workpool *wp __attribute__ ((unused)),void *vit){
+  struct indextask *it = vit;
+  nameindex *ni = it->ni;
+  size_t z,id;
+
+  id = it->base - 1; // wraps to base upon our first name
+  for(z = it->lo ; z < it->hi ; ++z){
+    const nameent *ne = &ni->ents[z];
+    uint32_t cur;
+    size_t h;
+
+    ni->objs[z] = ne->obj;
+    if(!name_starts(ni->ents,z)){
+      if(it->fxn){
+        it->fxn(ne->obj,id);
+      }
+      continue;
+    }
+    ni->first[++id] = z;
+    if(it->fxn){
+      it->fxn(ne->obj,id);
+    }
+    h = hash_name(ne->name,ne->len) & ni->mask;
+    for(;;){
+      cur = 0;
+      if(atomic_compare_exchange_strong_explicit(&ni->slots[h],&cur,z + 1,
+            memory_order_relaxed,memory_order_relaxed)){
+        break;
+      }
+      h = (h + 1) & ni->mask;
+    }
+  }
+  return 0;
+}
+
+static int
+run_tasks(worktaskfxn fxn,struct indextask *its,unsigned n,unsigned threads,
+          struct raptorial_pool *rpool){
+  workpool wp;
+  unsigned z;
+  int r;
+
+  // With a pool, even a lone task is run on it, off the calling thread.
+  if(rpool == NULL && (threads <= 1 || n <= 1)){
+    for(z = 0 ; z < n ; ++z){
+      fxn(NULL,&its[z]);
+    }
+    return 0;
+  }
+  if( (r = workpool_init(&wp,threads,rpool)) ){
+    return r;
+  }
+  for(z = 0 ; z < n ; ++z){
+    if( (r = workpool_submit(&wp,fxn,&its[z])) ){
+      break;
+    }
+  }
+  if(workpool_run(&wp,&r) == 0 && z == n){
+    r = 0;
+  }
+  workpool_destroy(&wp);
+  return r;
+}
+
+// Sort one run per worker, and merge pairs of runs until one remains. Then
+// split the sorted entries among the workers, which count the names starting
+// in their spans, and (given the sum of those before them) number and hash
+// them.
+int nameindex_build(nameindex *ni,nameent *ents,size_t count,unsigned threads,
+                    struct raptorial_pool *rpool,nameidfxn fxn){
+  struct indextask *its;
+  nameent *src,*dst;
+  unsigned z,n,width;
+  size_t slots;
+  int r;
+
+  memset(ni,0,sizeof(*ni));
+  if(count >= UINT32_MAX){
+    free(ents);
+    return EOVERFLOW;
+  }
+  if(count < INDEX_PARALLEL_MIN || threads == 0){
+    threads = 1;
+  }
+  for(slots = 16 ; slots < count * 2 ; slots *= 2){
+    ;
+  }
+  its = malloc(sizeof(*its) * threads);
+  dst = malloc(sizeof(*dst) * (count ? count : 1));
+  ni->objs = malloc(sizeof(*ni->objs) * (count ? count : 1));
+  ni->slots = calloc(slots,sizeof(*ni->slots));
+  if(its == NULL || dst == NULL || ni->objs == NULL || ni->slots == NULL){
+    r = errno;
+    goto err;
+  }
+#define RUNBOUND(x) (count * (x) / threads)
+  for(z = 0 ; z < threads ; ++z){
+    its[z].src = ents;
+    its[z].lo = RUNBOUND(z);
+    its[z].hi = RUNBOUND(z + 1);
+  }
+  if( (r = run_tasks(sort_task,its,threads,threads,rpool)) ){
+    goto err;
+  }
+  src = ents;
+  for(width = 1 ; width < threads ; width *= 2){
+    nameent *tmp;
+
+    for(n = 0, z = 0 ; z < threads ; z += 2 * width, ++n){
+      its[n].src = src;
+      its[n].dst = dst;
+      its[n].lo = RUNBOUND(z);
+      its[n].mid = RUNBOUND(z + width < threads ? z + width : threads);
+      its[n].hi = RUNBOUND(z + 2 * width < threads ? z + 2 * width : threads);
+    }
+    if( (r = run_tasks(merge_task,its,n,threads,rpool)) ){
+      dst = src == ents ? dst : src; // free whichever isn't ents
+      goto err;
+    }
+    tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+  ni->ents = src;
+  ni->count = count;
+  ni->mask = slots - 1;
+  for(z = 0 ; z < threads ; ++z){
+    its[z].ni = ni;
+    its[z].fxn = fxn;
+    its[z].lo = RUNBOUND(z);
+    its[z].hi = RUNBOUND(z + 1);
+  }
+#undef RUNBOUND
+  free(dst); // the other buffer
+  dst = NULL;
+  ents = ni->ents;
+  if( (r = run_tasks(count_task,its,threads,threads,rpool)) ){
+    goto err;
+  }
+  for(z = 0 ; z < threads ; ++z){
+    size_t names = its[z].base;
+
+    its[z].base = ni->names;
+    ni->names += names;
+  }
+  if((ni->first = malloc(sizeof(*ni->first) * (ni->names ? ni->names : 1))) == NULL){
+    r = errno;
+    goto err;
+  }
+  if( (r = run_tasks(hash_task,its,threads,threads,rpool)) ){
+    goto err;
+  }
+  free(its);
+  return 0;
+
+err:
+  free(its);
+  free(dst);
+  free(ents);
+  free(ni->objs);
+  free(ni->first);
+  free((void *)ni->slots);
+  memset(ni,0,sizeof(*ni));
+  return r;
+}
+
+size_t nameindex_lookup(const nameindex *ni,const char *name,size_t len,
+                        size_t *first){
+  uint32_t cur;
+  size_t h,n;
+
+  if(ni->slots == NULL){
+    return 0;
+  }
+  h = hash_name(name,len) & ni->mask;
+  while( (cur = atomic_load_explicit(&ni->slots[h],memory_order_relaxed)) ){
+    const nameent *ne = &ni->ents[cur - 1];
+
+    if(namecmp(ne->name,ne->len,name,len) == 0){
+      *first = cur - 1;
+      for(n = 1 ; cur - 1 + n < ni->count ; ++n){
+        if(namecmp(ne[n].name,ne[n].len,name,len)){
+          break;
+        }
+      }
+      return n;
+    }
+    h = (h + 1) & ni->mask;
+  }
+  return 0;
+}
+
+int64_t nameindex_id(const nameindex *ni,const char *name,size_t len){
+  size_t first,lo,hi;
+
+  if(nameindex_lookup(ni,name,len,&first) == 0){
+    return -1;
+  }
+  // Ids are assigned in sorted order; search for the one whose first entry
+  // this is.
+  lo = 0;
+  hi = ni->names;
+  while(lo < hi){
+    size_t mid = lo + (hi - lo) / 2;
+
+    if(ni->first[mid] < first){
+      lo = mid + 1;
+    }else{
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Returns the index of the first entry not less than the name.
+static size_t
+lower_bound(const nameindex *ni,const char *name,size_t len){
+  size_t lo = 0,hi = ni->count;
+
+  while(lo < hi){
+    size_t mid = lo + (hi - lo) / 2;
+
+    if(namecmp(ni->ents[mid].name,ni->ents[mid].len,name,len) < 0){
+      lo = mid + 1;
+    }else{
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+size_t nameindex_prefix(const nameindex *ni,const char *prefix,size_t len,
+                        size_t *first){
+  size_t z;
+
+  *first = lower_bound(ni,prefix,len);
+  for(z = *first ; z < ni->count ; ++z){
+    if(ni->ents[z].len < len || memcmp(ni->ents[z].name,prefix,len)){
+      break;
+    }
+  }
+  return z - *first;
+}
+
+size_t nameindex_range(const nameindex *ni,const char *lo,size_t lolen,
+                       const char *hi,size_t hilen,size_t *first){
+  size_t end;
+
+  *first = lower_bound(ni,lo,lolen);
+  end = hi ? lower_bound(ni,hi,hilen) : ni->count;
+  return end > *first ? end - *first : 0;
+}
+
+void nameindex_free(nameindex *ni){
+  free(ni->ents);
+  free(ni->objs);
+  free(ni->first);
+  free((void *)ni->slots);
+  memset(ni,0,sizeof(*ni));
+}
@@ -0,0 +1,59 @@
+#ifndef RAPTORIAL_NAMEINDEX
+#define RAPTORIAL_NAMEINDEX
+
+// private name index for raptorial
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+struct raptorial_pool;
+
+// Names are length-delimited, as they might be views into a list.
+typedef struct nameent {
+  const char *name;
+  size_t len;
+  const void *obj;
+} nameent;
+
+// The entries are sorted by name (bytewise), supporting prefix and range
+// scans, and a parallel array holds their objects in the same order. An
+// open-addressing hash table maps each distinct name to its first entry,
+// for O(1) lookups. Both are built in parallel. Distinct names are numbered
+// densely, in sorted order, by the same pass.
+typedef struct nameindex {
+  nameent *ents;
+  const void **objs;
+  size_t count;
+  size_t names;    // distinct names
+  uint32_t *first; // index of each name id's first entry
+  // Each slot holds 1 + the index of a name's first entry, or 0 if empty.
+  // Slots are claimed with a compare-and-swap during the parallel build.
+  _Atomic uint32_t *slots;
+  size_t mask; // slots - 1; slots is a power of 2
+} nameindex;
+
+// Called with each entry's object and its name's id, from the building
+// threads. May be NULL.
+typedef void (*nameidfxn)(const void *,uint32_t);
+
+// Takes ownership of ents (which must have been allocated with malloc()).
+// Builds with up to the specified number of threads, on the raptorial_pool
+// if it's non-NULL. Returns 0 on success, or an errno value, in which case
+// ents is freed.
+int nameindex_build(nameindex *,nameent *,size_t,unsigned,
+                    struct raptorial_pool *,nameidfxn);
+
+// The id of the name, or -1 if it's not present.
+int64_t nameindex_id(const nameindex *,const char *,size_t);
+
+// Each writes the index of the first matching entry through, and returns the
+// number of (contiguous) matches.
+size_t nameindex_lookup(const nameindex *,const char *,size_t,size_t *);
+size_t nameindex_prefix(const nameindex *,const char *,size_t,size_t *);
+// Names within [lo, hi). A NULL hi extends through the last name.
+size_t nameindex_range(const nameindex *,const char *,size_t,
+                       const char *,size_t,size_t *);
+
+void nameindex_free(nameindex *);
+
+#endif
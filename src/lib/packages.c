@@ -1,138 +1,546 @@
 #include <aac.h>
+#include <pool.h>
+#include <arena.h>
+#include <scan.h>
 #include <util.h>
+#include <decomp.h>
+#include <nameindex.h>
+#include <pkgtable.h>
+#include <pkgset.h>
+#include <sources.h>
+#include <uring.h>
+#include <threadpool.h>
 #include <ctype.h>
 #include <errno.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <dirent.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <assert.h>
 #include <unistd.h>
 #include <pthread.h>
-#include <blossom.h>
+#include <stdatomic.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <raptorial.h>
 
+// A captured field value. In a zero-copy list, a view into the mapping;
+// otherwise, a NUL-terminated copy. val is NULL if the field was absent.
+typedef raptorial_field fieldview;
+
 // For now, the datastore is a trie, anchored by selection packages (either
 // those specified on the command line, or those currently installed). These
 // dist-wide linked lists ought not be used for searching, and no interface is
 // provided to do so.
+//
+// If the list captured fields, a fieldview for each immediately follows the
+// pkgobj, in the order they were requested (see pkgobj_captures()). If the
+// list was deduplicated, its origins follow those (see pkgobj_origins()).
 typedef struct pkgobj {
   struct pkgobj *next;
-  char *name;
-  char *version;
+  // NUL-terminated copies, unless our list was lexed with
+  // RAPTORIAL_LEX_ZEROCOPY, in which case they're views into its mapping.
+  const char *name;
+  const char *version;
+  unsigned namelen,verlen;
+  // The package's stanza within its list's mapping, from its first line
+  // through the newline ending its last. Only meaningful if the mapping was
+  // retained (see pkglist_hasmap()); NULL for stub packages.
+  const char *stanza;
+  unsigned stanzalen;
+  // The dense id of our name, assigned when our cache is indexed;
+  // RAPTORIAL_NONAMEID until then.
+  uint32_t nameid;
   const struct pkglist *pl;
-  int haslock;
 
-  pthread_mutex_t lock;
-  struct pkgobj *dfanext;
+  // Matches found by filtered lexing are pushed onto their anchor's chain
+  // with a compare-and-swap, so any number of chunk tasks can attach to a
+  // popular anchor (libc6, say) without serializing on it. Read the chain
+  // with next_match().
+  _Atomic(struct pkgobj *) dfanext;
 } pkgobj;
 
+// A deduplicated pkgobj stands in for its (name, version) in every list of
+// the directory, each of which sets its bit (by list id) in bits. next chains
+// the pkgobjs of a deduptab bucket.
+typedef struct origins {
+  _Atomic(struct pkgobj *) next;
+  _Atomic uint64_t bits[];
+} origins;
+
+// A compressed list is decompressed into segments, each ending on a stanza
+// boundary, which are lexed as they're produced. Each segment is its own
+// task; pp is the list being lexed.
+typedef struct segment {
+  struct segment *next;
+  struct pkgparse *pp;
+  size_t len,size;
+  char data[];
+} segment;
+
 // One package cache per Packages/Sources file. A release will generally have
 // { |Architectures| X |Components| } Packages files, and one Sources file per
 // component.
+// The pkgobjs of a list, along with their names and versions, are allocated
+// from its arena, and released together with the list.
 typedef struct pkglist {
   pkgobj *pobjs;
   unsigned pcount;
   struct pkglist *next;
-  char *uri,*arch,*distribution;
+  char *uri,*arch,*distribution,*component;
+  arena arena;
+  unsigned flags; // RAPTORIAL_LEX_* used to lex us
+  struct raptorial_pool *rpool; // lexed us, and indexes us as a cache
+  const char **fields; // fields captured by our pkgobjs, in our arena
+  unsigned nfields;
+  // The list's mapping (or, for a compressed list, its decompressed
+  // segments) is retained only when pkgobjs refer into it.
+  const void *map;
+  size_t maplen;
+  segment *segs;
+  // A columnar list has no pkgobjs; its packages are held in one tableseg
+  // per chunk until its cache gathers them into a pkgtable.
+  tableseg *tsegs;
+  // A directory's lists are identified by their index into its cache's
+  // byid. origwords is the size of our pkgobjs' origin bitsets in words, or
+  // 0 if they weren't deduplicated.
+  unsigned listid,origwords;
+  struct pkglist * const *siblings; // the cache's byid
+  // A directory's list remembers its file, so that pkgcache_refresh() can
+  // tell whether it's changed. stale marks a list to be dropped by it.
+  char *path;
+  struct stat st;
+  int stale;
 } pkglist;
 
+// Is the list's data retained, so that its stanzas can be examined?
+static inline int
+pkglist_hasmap(const pkglist *pl){
+  return pl->flags & (RAPTORIAL_LEX_ZEROCOPY | RAPTORIAL_LEX_FIELDS);
+}
+
 // For now, just a flat list of pkglists; we'll likely introduce structure.
+// If lexed with RAPTORIAL_LEX_INDEX, the packages of all lists are indexed
+// by name. If lexed with RAPTORIAL_LEX_COLUMNAR, they're instead in table.
 typedef struct pkgcache {
   pkglist *lists;
+  nameindex idx;
+  pkgtable *table;
+  pkglist **byid; // a directory's lists by list id; NULL otherwise
+  unsigned nlists;
+  // A directory's cache is refreshed as it was lexed. If attached, dfa was
+  // attached by pkgcache_attach() rather than filtering the lists.
+  struct dfa *dfa;
+  raptorial_lexopts opts;
+  int attached;
 } pkgcache;
 
+static inline origins *
+pkgobj_origins(const pkgobj *po){
+  if(po->pl == NULL || po->pl->origwords == 0){
+    return NULL;
+  }
+  return (origins *)((fieldview *)(po + 1) + po->pl->nfields);
+}
+
+// Deduplication table for a directory's lists, keyed by (name, version).
+// Buckets are chained through the pkgobjs' origins, and new pkgobjs are
+// pushed onto a bucket's head with a compare-and-swap. Chains only grow, so
+// a failed swap need only search the pkgobjs pushed since the last attempt.
+typedef struct deduptab {
+  _Atomic(pkgobj *) *buckets;
+  size_t mask; // buckets - 1; buckets is a power of 2
+  unsigned words; // origin bitset words per pkgobj
+} deduptab;
+
+// FNV-1a over the name, then the version
+static inline size_t
+dedup_hash(const char *name,size_t namelen,const char *ver,size_t verlen){
+  uint64_t h = 14695981039346656037ull;
+
+  while(namelen--){
+    h ^= (unsigned char)*name++;
+    h *= 1099511628211ull;
+  }
+  h ^= 0xff; // no name ends in 0xff, so (ab, c) and (a, bc) differ
+  h *= 1099511628211ull;
+  while(verlen--){
+    h ^= (unsigned char)*ver++;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+// Search the chain from po up to (but not including) stop.
+static const pkgobj *
+dedup_search(const pkgobj *po,const pkgobj *stop,const char *name,
+             size_t namelen,const char *ver,size_t verlen){
+  while(po != stop){
+    if(po->namelen == namelen && po->verlen == verlen &&
+        !po->version == !ver && memcmp(po->name,name,namelen) == 0 &&
+        (ver == NULL || memcmp(po->version,ver,verlen) == 0)){
+      return po;
+    }
+    po = atomic_load_explicit(&pkgobj_origins(po)->next,memory_order_acquire);
+  }
+  return NULL;
+}
+
+static inline void
+add_origin(const pkgobj *po,unsigned listid){
+  atomic_fetch_or_explicit(&pkgobj_origins(po)->bits[listid / 64],
+                           1ull << (listid % 64),memory_order_relaxed);
+}
+
+struct dirparse;
+
+// Roles of the fields lex_chunk() always recognizes. Requested fields may
+// coincide with these, in which case they're captured as well.
+enum {
+  ROLE_NONE,
+  ROLE_PACKAGE,
+  ROLE_VERSION,
+  ROLE_STATUS,
+};
+
+struct fieldrec {
+  const char *tag; // without the colon
+  size_t taglen;
+  int role;
+  int slot; // index into the requested fields, or -1
+};
+
+// Recognition table for the fields we lex. Records are sorted by the first
+// character of their tag, and indexed by it (in either case), so a line is
+// only compared against the records sharing its first character. Most lines
+// share it with no record, and cost a single lookup.
+typedef struct fieldtab {
+  struct fieldrec *recs;
+  unsigned short first[256],count[256];
+  const char * const *fields; // requested fields (the caller's)
+  unsigned nfields;
+  // If cb is non-NULL, each stanza is handed to it as it's lexed, rather
+  // than becoming a pkgobj.
+  raptorial_stanzacb cb;
+  void *opaque;
+} fieldtab;
+
+// Parse state for a single list, shared by the tasks lexing its chunks.
 struct pkgparse {
-  unsigned count;
   const void *mem;
   size_t len,csize;
   // Are we a status file, or a package list?
   int statusfile;
+  unsigned flags; // RAPTORIAL_LEX_*
+  const fieldtab *ft;
+  // filter is 0 if we're building the dfa, 1 if we're being filtered by
+  // the dfa, and undefined if dfa == NULL. It is latched before lexing,
+  // since the first chunk to complete will make *dfa non-NULL.
   struct dfa **dfa;
+  unsigned filter;
+  pkglist *sharedpcache;
+  struct dirparse *dp; // NULL unless we're one list of a directory
+  deduptab *dedup; // NULL unless we're being deduplicated
+  int fd;
+  int discard; // drop each chunk's pages once it's been lexed
+  struct chunkparse *cparse; // one per chunk, NULL if we're compressed
+  unsigned chunks;
+  // A compressed list is lexed as a stream of segments; mem is then the
+  // compressed data. So is a list read from infd, when it's not -1 (mem is
+  // then NULL). Only the task producing segments touches these.
+  compkind comp;
+  decomp dc;
+  int infd;
+  segment *pending; // the partial stanza carried into the next segment
+  int streamdone;
+
+  // These data are modified by chunk tasks, and must be protected by the
+  // lock. Parsed pkgobjs are placed in sharedpcache. Whichever task takes
+  // chunksleft to 0 finishes the list. While a compressed list is being
+  // decompressed, the producer holds one count of chunksleft, and each
+  // segment adds one as it's produced. A list read from infd is read ahead
+  // of its lexers by only so many segments, its reader waiting on drained.
   pthread_mutex_t lock;
+  pthread_cond_t drained; // only initialized if infd is not -1
+  unsigned chunksleft;
+  int err;
+};
 
-  // These data are modified by threads, and must be protected by the
-  // lock. A thread takes the chunk at offset, incrementing offset by
-  // the chunksize. Parsed pkgobjs are placed in sharedpcache.
+// A chunk task lexes the csize bytes of pp->mem beginning at offset.
+struct chunkparse {
+  struct pkgparse *pp;
   size_t offset;
-  pkglist *sharedpcache;
+  int lexed; // only maintained when discarding, under the lock
 };
 
-static void
-free_package(pkgobj *po){
-  if(po->haslock){
-    assert(pthread_mutex_destroy(&po->lock) == 0);
+// The ncaps captured fields follow the pkgobj, and unless we're zero-copy,
+// the name, version and captured values are stored after them, in the same
+// allocation. If ar is NULL, the pkgobj is allocated from the heap, and must
+// be released with free(); otherwise, it belongs to the arena.
+// origwords words of origin bitset are reserved (and zeroed) after the
+// captured fields, if non-zero.
+static pkgobj *
+create_package(arena *ar,const char *name,size_t namelen,const char *ver,
+               size_t verlen,const fieldview *caps,unsigned ncaps,
+               const pkglist *pl,int zerocopy,unsigned origwords){
+  size_t len = sizeof(pkgobj) + sizeof(*caps) * ncaps;
+  fieldview *fv;
+  unsigned z;
+  pkgobj *po;
+
+  if(origwords){
+    len += sizeof(origins) + sizeof(uint64_t) * origwords;
   }
-  free(po->version);
-  free(po->name);
-  free(po);
-}
 
-static inline int
-fill_package(pkgobj *po,const char *ver,size_t verlen,const pkglist *pl){
-  if(ver){
-    if((po->version = malloc(sizeof(*po->version) * (verlen + 1))) == NULL){
-      return -1;
+  if(!zerocopy){
+    len += namelen + 1 + (ver ? verlen + 1 : 0);
+    for(z = 0 ; z < ncaps ; ++z){
+      if(caps[z].val){
+        len += caps[z].len + 1;
+      }
     }
-    strncpy(po->version,ver,verlen);
-    po->version[verlen] = '\0';
+  }
+  if((po = ar ? arena_alloc(ar,len) : malloc(len)) == NULL){
+    return NULL;
+  }
+  fv = (fieldview *)(po + 1);
+  memcpy(fv,caps,sizeof(*caps) * ncaps);
+  po->namelen = namelen;
+  po->verlen = ver ? verlen : 0;
+  if(zerocopy){
+    po->name = name;
+    po->version = ver;
   }else{
-    po->version = NULL;
+    char *n = (char *)(fv + ncaps);
+
+    if(origwords){
+      n += sizeof(origins) + sizeof(uint64_t) * origwords;
+    }
+
+    memcpy(n,name,namelen);
+    n[namelen] = '\0';
+    po->name = n;
+    n += namelen + 1;
+    if(ver){
+      memcpy(n,ver,verlen);
+      n[verlen] = '\0';
+      po->version = n;
+      n += verlen + 1;
+    }else{
+      po->version = NULL;
+    }
+    for(z = 0 ; z < ncaps ; ++z){
+      if(fv[z].val){
+        memcpy(n,fv[z].val,fv[z].len);
+        n[fv[z].len] = '\0';
+        fv[z].val = n;
+        n += fv[z].len + 1;
+      }
+    }
+  }
+  if(origwords){
+    origins *o = (origins *)(fv + ncaps);
+
+    atomic_init(&o->next,NULL);
+    for(z = 0 ; z < origwords ; ++z){
+      atomic_init(&o->bits[z],0);
+    }
   }
-  po->dfanext = NULL;
+  po->stanza = NULL;
+  po->stanzalen = 0;
+  po->nameid = RAPTORIAL_NONAMEID;
+  atomic_init(&po->dfanext,NULL);
   po->next = NULL;
   po->pl = pl;
-  return 0;
+  return po;
 }
 
+// Returns the pkgobj for (name, version), creating it if no list has yet,
+// and marks it as found in pp's list. *created is set if the pkgobj is new,
+// in which case it belongs to our list (and arena).
 static pkgobj *
-create_package(const char *name,size_t namelen,const char *ver,size_t verlen,
-          const pkglist *pl){
-  pkgobj *po;
+dedup_package(deduptab *dt,arena *ar,const char *name,size_t namelen,
+              const char *ver,size_t verlen,const fieldview *caps,
+              const struct pkgparse *pp,int zerocopy,int *created){
+  const pkglist *pl = pp->sharedpcache;
+  _Atomic(pkgobj *) *bucket;
+  const pkgobj *found;
+  pkgobj *head,*po;
 
-  if( (po = malloc(sizeof(*po))) ){
-    if((po->name = malloc(sizeof(*po->name) * (namelen + 1))) == NULL){
-      free(po);
-      return NULL;
+  if(ver == NULL){
+    verlen = 0;
+  }
+  bucket = &dt->buckets[dedup_hash(name,namelen,ver,verlen) & dt->mask];
+  head = atomic_load_explicit(bucket,memory_order_acquire);
+  *created = 0;
+  if( (found = dedup_search(head,NULL,name,namelen,ver,verlen)) ){
+    add_origin(found,pl->listid);
+    return (pkgobj *)found;
+  }
+  if((po = create_package(ar,name,namelen,ver,verlen,caps,pp->ft->nfields,
+                          pl,zerocopy,dt->words)) == NULL){
+    return NULL;
+  }
+  add_origin(po,pl->listid);
+  for(;;){
+    pkgobj *prev = head;
+
+    atomic_store_explicit(&pkgobj_origins(po)->next,head,memory_order_relaxed);
+    if(atomic_compare_exchange_weak_explicit(bucket,&head,po,
+          memory_order_release,memory_order_acquire)){
+      *created = 1;
+      return po;
     }
-    strncpy(po->name,name,namelen);
-    po->name[namelen] = '\0';
-    if(fill_package(po,ver,verlen,pl)){
-      free(po->name);
-      free(po);
+    // Our pkgobj is abandoned to the arena if another list beat us to it.
+    if( (found = dedup_search(head,prev,name,namelen,ver,verlen)) ){
+      add_origin(found,pl->listid);
+      return (pkgobj *)found;
     }
   }
-  return po;
 }
 
-static size_t
-get_new_offset(struct pkgparse *pp){
-  size_t o;
+// Attach po to the anchor mpo. po is not yet visible to anyone else, so
+// only the anchor's head need be swapped in.
+static inline void
+push_match(pkgobj *mpo,pkgobj *po){
+  pkgobj *head = atomic_load_explicit(&mpo->dfanext,memory_order_relaxed);
 
-  pthread_mutex_lock(&pp->lock);
-  o = pp->offset;
-  if(pp->len - pp->offset < pp->csize){ // Avoids possible overflow
-    pp->offset = pp->len;
-  }else{
-    pp->offset += pp->csize;
+  do{
+    atomic_store_explicit(&po->dfanext,head,memory_order_relaxed);
+  }while(!atomic_compare_exchange_weak_explicit(&mpo->dfanext,&head,po,
+                memory_order_release,memory_order_relaxed));
+}
+
+static inline const pkgobj *
+next_match(const pkgobj *po){
+  return atomic_load_explicit(&((pkgobj *)po)->dfanext,memory_order_acquire);
+}
+
+static int
+fieldrec_cmp(const void *va,const void *vb){
+  const struct fieldrec *a = va,*b = vb;
+
+  return tolower((unsigned char)*a->tag) - tolower((unsigned char)*b->tag);
+}
+
+// Build the recognition table for the NULL-terminated list of requested
+// fields (which may be NULL), which must outlive the table.
+static int
+init_fieldtab(fieldtab *ft,const char * const *fields){
+  static const struct fieldrec builtins[] = {
+    { "Package", 7, ROLE_PACKAGE, -1, },
+    { "Version", 7, ROLE_VERSION, -1, },
+    { "Status", 6, ROLE_STATUS, -1, },
+  };
+  const unsigned nbuiltins = sizeof(builtins) / sizeof(*builtins);
+  unsigned z,y,nrecs;
+
+  memset(ft,0,sizeof(*ft));
+  ft->fields = fields;
+  while(fields && fields[ft->nfields]){
+    ++ft->nfields;
   }
-  pthread_mutex_unlock(&pp->lock);
-  return o;
+  if(ft->nfields >= USHRT_MAX - nbuiltins){
+    return EINVAL;
+  }
+  if((ft->recs = malloc(sizeof(*ft->recs) * (nbuiltins + ft->nfields))) == NULL){
+    return errno;
+  }
+  memcpy(ft->recs,builtins,sizeof(builtins));
+  nrecs = nbuiltins;
+  for(z = 0 ; z < ft->nfields ; ++z){
+    const char *f = fields[z];
+
+    if(*f == '\0' || strpbrk(f,": \t\n")){
+      free(ft->recs);
+      return EINVAL;
+    }
+    for(y = 0 ; y < nrecs ; ++y){
+      if(strcasecmp(ft->recs[y].tag,f) == 0){
+        break;
+      }
+    }
+    if(y == nrecs){
+      ft->recs[nrecs].tag = f;
+      ft->recs[nrecs].taglen = strlen(f);
+      ft->recs[nrecs].role = ROLE_NONE;
+      ft->recs[nrecs].slot = -1;
+      ++nrecs;
+    }else if(ft->recs[y].slot >= 0){ // requested twice
+      free(ft->recs);
+      return EINVAL;
+    }
+    ft->recs[y].slot = z;
+  }
+  qsort(ft->recs,nrecs,sizeof(*ft->recs),fieldrec_cmp);
+  for(z = nrecs ; z-- ; ){
+    unsigned char lc = tolower((unsigned char)*ft->recs[z].tag);
+    unsigned char uc = toupper(lc);
+
+    ft->first[lc] = ft->first[uc] = z;
+    ++ft->count[lc];
+    if(uc != lc){
+      ++ft->count[uc];
+    }
+  }
+  return 0;
 }
 
-enum {
-  STATE_PDATA = 0,
-  STATE_NLINE = 1,
-  STATE_RESET = 2,
-  STATE_EXPECT,
-  STATE_DELIM,
-  STATE_VERSION_DELIMITED,
-  STATE_PACKAGE_DELIMITED,
-  STATE_STATUS_DELIMITED,
-};
+static void
+free_fieldtab(fieldtab *ft){
+  free(ft->recs);
+}
+
+// If the line [c, eol) is one of our fields, returns its record, and writes
+// through the start of its value (the tag's trailing whitespace having been
+// chewed; this might be eol). Tags are matched without regard to case.
+static inline const struct fieldrec *
+match_field(const fieldtab *ft,const char *c,const char *eol,const char **val){
+  const struct fieldrec *fr,*frend;
+  unsigned char fc = *c;
+
+  fr = ft->recs + ft->first[fc];
+  for(frend = fr + ft->count[fc] ; fr < frend ; ++fr){
+    if((size_t)(eol - c) > fr->taglen && c[fr->taglen] == ':' &&
+        strncasecmp(c,fr->tag,fr->taglen) == 0){
+      for(c += fr->taglen + 1 ; c < eol && isspace(*c) ; ++c){
+        ;
+      }
+      *val = c;
+      return fr;
+    }
+  }
+  return NULL;
+}
+
+// Hand a stanza's views to the caller's callback. A failure is recorded
+// with the list, as the callback's return value.
+static int
+stanza_callback(struct pkgparse *pp,const char *name,size_t namelen,
+                const char *ver,size_t verlen,const char *start,
+                const char *end,const fieldview *caps){
+  raptorial_stanza st = {
+    .package = { name, namelen, },
+    .version = { ver, ver ? verlen : 0, },
+    .text = { start, end - start, },
+    .fields = caps,
+    .worker = workpool_id(),
+  };
+  int r;
+
+  if( (r = pp->ft->cb(&st,pp->ft->opaque)) ){
+    pthread_mutex_lock(&pp->lock);
+      if(pp->err == 0){
+        pp->err = r;
+      }
+    pthread_mutex_unlock(&pp->lock);
+  }
+  return r;
+}
 
 // Threads handle chunks of the packages list. Since we don't know where
 // package definitions are split in the list data, we'll usually toss some data
@@ -142,6 +550,10 @@ enum {
 // we just always locally discover the bounds (put another way, the overlapping
 // areas at the front and back of chunks are lexed twice).
 //
+// We never look at most of the bytes: a linescan finds the newlines 64 bytes
+// at a time, and only line starts are examined, by way of the fieldtab, for
+// the tags we care about. An empty line ends a package.
+//
 // Returns the number of packages parsed (possibly 0), or -1 on error. In the
 // case of an error, packages already parsed *are not* freed, and enq *is
 // not* reset.
@@ -155,23 +567,24 @@ enum {
 // pointer, use that as a filter for construction of our list.
 static int
 lex_chunk(size_t offset,const char *start,const char *end,
-    const char *veryend,pkgobj ***enq,
+    const char *veryend,pkgobj ***enq,arena *ar,
     struct pkgparse *pp){
-  const char *expect,*pname,*pver,*pstatus,*c,*delim;
+  const char *pname,*pver,*pstatus,*pstart,*c,*eol,*val;
+  // A columnar list's pkgobjs are transient, and copied into its table
+  // before the chunk's data can go away; they needn't copy anything.
+  int zerocopy = !!(pp->flags & (RAPTORIAL_LEX_ZEROCOPY | RAPTORIAL_LEX_COLUMNAR));
+  int columnar = !!(pp->flags & RAPTORIAL_LEX_COLUMNAR);
+  const fieldtab *ft = pp->ft;
+  fieldview caps[ft->nfields + 1],*cont;
+  unsigned filter = pp->filter;
+  const struct fieldrec *fr;
   size_t pnamelen,pverlen;
-  int rewardstate,state;
   unsigned newp = 0;
-  unsigned filter;
+  int inpackage;
+  linescan ls;
   dfactx dctx;
   pkgobj *po;
 
-  // filter is 0 if we're building the dfa, 1 if we're being filtered by
-  // the dfa, and undefined if dga == NULL
-  if(pp->dfa){
-    filter = *(pp->dfa) ? 1 : 0;
-  }else{
-    filter = 0; // FIXME get rid of this when gcc improves
-  }
   // First, find the start of our chunk:
   //  - If we are offset 0, we are at the start of our chunk
   //  - Otherwise, if the previous two characters (those preceding our
@@ -180,41 +593,34 @@ lex_chunk(size_t offset,const char *start,const char *end,
   //     character is a newline, we are at the start of our chunk
   //  - Otherwise, our chunk starts at the first double newline
   if(offset){
-    // We can be in one of two states: we know the previous
-    // character to have been a newline, or we don't.
-    state = STATE_PDATA;
+    const char *prev = NULL;
+
     //assert(pp->csize > 2); // sanity check
-    for(c = start - 2 ; c < end ; ++c){
-      if(*c == '\n'){
-        if(state == STATE_NLINE){
-          ++c;
-          break;
-        }
-        state = STATE_NLINE;
-      }else{
-        state = STATE_PDATA;
+    linescan_init(&ls,start - 2,veryend);
+    for(c = end ; (eol = linescan_next(&ls)) < end ; prev = eol){
+      if(prev && prev + 1 == eol){
+        c = eol + 1;
+        break;
       }
     }
   }else{
     c = start;
+    linescan_init(&ls,start,veryend);
   }
   // We are at the beginning of our chunk, which might be 0 bytes. Any
-  // partial record with which our map started has been skipped
-  // Upon reaching the (optional, only one allowed) delimiter on each
-  // line, delim will be updated to point one past that delimiter (which
-  // might be outside the chunk!), and to chew whitespace.
-  delim = NULL;
-  expect = NULL;
-  // We hand create_package our raw map bytes; it allocates the destbuf.
-  // These are thus reset on each package.
-  pname = NULL; pver = NULL; pstatus = NULL;
-  state = STATE_RESET; // number of newlines we've seen, bounded by 2
-  rewardstate = STATE_RESET;
+  // partial record with which our map started has been skipped. From here
+  // on, c is always at the start of a line. We hand create_package our raw
+  // map bytes; it copies them into the arena, or refers to them directly if
+  // we're zero-copy. These are thus reset on each package.
+  pname = NULL; pver = NULL; pstatus = NULL; pstart = NULL; cont = NULL;
   pverlen = pnamelen = 0;
-  while(c < end || (state != STATE_RESET && c < veryend)){
-    if(*c == '\n'){ // State machine is driven by newlines
-      switch(state){
-      case STATE_NLINE:{ // double newline
+  inpackage = 0;
+  while(c < end || (inpackage && c < veryend)){
+    // linescan never returns a newline prior to c, since c always follows
+    // the last newline it returned.
+    eol = linescan_next(&ls);
+    if(eol == c){ // empty line
+      if(inpackage){ // double newline
         if(pname == NULL || pnamelen == 0){
           return -1; // No package name
         }
@@ -223,35 +629,41 @@ lex_chunk(size_t offset,const char *start,const char *end,
             return -1; // No package version
           }
         }
-        if(!pp->statusfile || pstatus){
-          if(pp->dfa && filter){
-            pkgobj *mpo;
+        if(ft->cb){
+          if(stanza_callback(pp,pname,pnamelen,pver,pverlen,pstart,c,caps)){
+            return -1;
+          }
+          po = NULL;
+        }else if(!pp->statusfile || pstatus){
+          pkgobj *mpo = NULL;
+          int created = 1;
 
+          if(pp->dfa && filter){
             init_dfactx(&dctx,*pp->dfa);
-            if( (mpo = match_dfactx_nstring(&dctx,pname,pnamelen)) ){
-              if((po = create_package(pname,pnamelen,pver,pverlen,pp->sharedpcache)) == NULL){
-                return -1;
-              }
-              pthread_mutex_lock(&mpo->lock);
-              po->dfanext = mpo->dfanext;
-              mpo->dfanext = po;
-              pthread_mutex_unlock(&mpo->lock);
-              po->haslock = 0;
-            }else{
-              po = NULL;
+            mpo = match_dfactx_nstring(&dctx,pname,pnamelen);
+          }
+          if(pp->dfa && filter && mpo == NULL){
+            po = NULL;
+          }else if(pp->dedup){
+            if((po = dedup_package(pp->dedup,ar,pname,pnamelen,pver,pverlen,caps,pp,zerocopy,&created)) == NULL){
+              return -1;
             }
-          }else if((po = create_package(pname,pnamelen,pver,pverlen,pp->sharedpcache)) == NULL){
+          }else if((po = create_package(ar,pname,pnamelen,pver,pverlen,caps,ft->nfields,pp->sharedpcache,zerocopy,0)) == NULL){
             return -1;
-          }else if(pthread_mutex_init(&po->lock,NULL)){
-            free_package(po);
-          }else{
-            po->haslock = 1;
+          }
+          // A duplicate is already on its anchor's chain, and in its list.
+          if(!created){
+            po = NULL;
+          }else if(mpo && !columnar){
+            push_match(mpo,po);
           }
         }else{
           po = NULL;
         }
         // Package ended!
         if(po){
+          po->stanza = pstart;
+          po->stanzalen = c - pstart;
           ++newp;
           **enq = po;
           *enq = &po->next;
@@ -259,215 +671,1028 @@ lex_chunk(size_t offset,const char *start,const char *end,
         pname = NULL;
         pver = NULL;
         pstatus = NULL;
-        state = STATE_RESET;
-        break;
-      } // Else we processed a line of the current package
-      case STATE_PACKAGE_DELIMITED:
-// Don't allow a package to be named twice. Defined another way, require an
-// empty line between every two instances of a Package: line.
-        if(pname){
-          return -1;
-        }
-        pnamelen = c - delim;
-        pname = delim;
-        break;
-      case STATE_VERSION_DELIMITED:
-        if(pver){
-          return -1;
-        }
-        pverlen = c - delim;
-        pver = delim;
-        break;
-      case STATE_STATUS_DELIMITED:
-        if(pstatus){
-          return -1;
-        }
-        pstatus = delim;
-        break;
+        cont = NULL;
+        inpackage = 0;
       }
-      if(state != STATE_RESET){
-        state = STATE_NLINE;
+    }else{ // Else we processed a line of the current package
+      if(!inpackage){
+        pstart = c;
+        memset(caps,0,sizeof(*caps) * ft->nfields);
       }
-    }else switch(state){ // not a newline
-      case STATE_NLINE:
-      case STATE_RESET:
-        delim = NULL;
-        start = c;
-        if(*c == 'V'){
-          state = STATE_EXPECT;
-          expect = "ersion:";
-          rewardstate = STATE_VERSION_DELIMITED;
-        }else if(*c == 'P'){
-          state = STATE_EXPECT;
-          expect = "ackage:";
-          rewardstate = STATE_PACKAGE_DELIMITED;
-        }else if(*c == 'S'){
-          state = STATE_EXPECT;
-          expect = "tatus: install ";
-          rewardstate = STATE_STATUS_DELIMITED;
-        }else{
-          state = STATE_PDATA;
+      inpackage = 1;
+      if(*c == ' ' || *c == '\t'){ // continuation line
+        if(cont){
+          cont->len = eol - cont->val;
         }
-        break;
-      case STATE_EXPECT:
-        if(*c == *expect){
-          if(!*++expect){
-            state = STATE_DELIM;
-            delim = c + 1;
+      }else if( (fr = match_field(ft,c,eol,&val)) ){
+        cont = NULL;
+        switch(fr->role){
+// Don't allow a package to be named twice. Defined another way, require an
+// empty line between every two instances of a Package: line.
+        case ROLE_PACKAGE:
+          if(val < eol){
+            if(pname){
+              return -1;
+            }
+            pnamelen = eol - val;
+            pname = val;
           }
-        }else{
-          state = STATE_PDATA;
+          break;
+        case ROLE_VERSION:
+          if(val < eol){
+            if(pver){
+              return -1;
+            }
+            pverlen = eol - val;
+            pver = val;
+          }
+          break;
+        case ROLE_STATUS:
+          if(eol - val > 8 && memcmp(val,"install ",8) == 0){
+            if(pstatus){
+              return -1;
+            }
+            pstatus = val;
+          }
+          break;
         }
-        break;
-      case STATE_DELIM:
-        if(isspace(*c)){
-          ++delim;
-        }else{
-          state = rewardstate;
+        // Only the first instance of a captured field is kept.
+        if(fr->slot >= 0 && caps[fr->slot].val == NULL){
+          cont = &caps[fr->slot];
+          cont->val = val;
+          cont->len = eol - val;
         }
-        break;
+      }else{
+        cont = NULL;
+      }
     }
-    ++c;
+    c = eol + 1;
   }
-  if(state != STATE_RESET){
+  if(inpackage){
     return -1;
   }
   return newp;
 }
 
-static void *
-lex_chunks(void *vpp){
-  const char *start,*end,*veryend;
-  struct pkgparse *pp = vpp;
+static int finish_dirlist(struct pkgparse *);
+
+// Copy a chunk's newp transient pkgobjs into a tableseg of exactly their size.
+static tableseg *
+tabulate_chunk(const pkgobj *head,unsigned newp){
+  size_t strbytes = 0;
+  const pkgobj *po;
+  tableseg *ts;
+
+  for(po = head ; po ; po = po->next){
+    strbytes += po->namelen + 1 + (po->version ? po->verlen + 1 : 0);
+  }
+  if((ts = tableseg_create(newp,strbytes)) == NULL){
+    return NULL;
+  }
+  for(po = head ; po ; po = po->next){
+    tableseg_add(ts,po->name,po->namelen,po->version,po->verlen);
+  }
+  return ts;
+}
+
+static inline int
+chunk_lexed(const struct pkgparse *pp,unsigned z){
+  return z >= pp->chunks || pp->cparse[z].lexed;
+}
+
+// Drop the pages wholly within chunk z of a file mapping from our resident
+// set. Its neighbours' lexers read into it while finishing and starting their
+// stanzas, and a discarded page would be refaulted (along with whatever
+// window the kernel maps around it), so it mustn't be discarded until they're
+// done too.
+static void
+discard_chunk(struct pkgparse *pp,unsigned z){
+  long pg = sysconf(_SC_PAGE_SIZE);
+  const char *start,*end;
+  uintptr_t s,e;
+
+  if(pg <= 0){
+    return;
+  }
+  start = (const char *)pp->mem + pp->cparse[z].offset;
+  end = pp->cparse[z].offset + pp->csize > pp->len ?
+        (const char *)pp->mem + pp->len : start + pp->csize;
+  s = ((uintptr_t)start + pg - 1) / pg * pg;
+  e = (uintptr_t)end / pg * pg;
+  if(e > s){
+    madvise((void *)s,e - s,MADV_DONTNEED);
+  }
+}
+
+// Chunk z has been lexed. Discard it and its neighbours, as they become
+// unneeded. Called with the lock held, so the list can't be finished (and
+// unmapped) beneath us.
+static void
+discard_chunks(struct pkgparse *pp,unsigned z){
+  unsigned y;
+
+  pp->cparse[z].lexed = 1;
+  for(y = z ? z - 1 : 0 ; y <= z + 1 && y < pp->chunks ; ++y){
+    if((y == 0 || chunk_lexed(pp,y - 1)) && chunk_lexed(pp,y) &&
+        chunk_lexed(pp,y + 1)){
+      discard_chunk(pp,y);
+    }
+  }
+}
+
+// Lex a single chunk (or segment), and splice its packages into the shared
+// list. The task which lexes the last outstanding chunk of a directory's list
+// finishes that list; lone lists are finished by their caller once the pool
+// has drained.
+static int
+lex_span(struct pkgparse *pp,size_t offset,const char *start,
+         const char *end,const char *veryend){
   pkgobj *head,**enq,*po;
-  unsigned packages = 0;
-  unsigned filter;
-  size_t offset;
+  tableseg *ts = NULL;
+  int newp,ret,r;
+  unsigned last;
+  arena ar;
 
   head = NULL;
   enq = &head;
-  filter = pp->dfa && *(pp->dfa) ? 1 : 0;
-  offset = get_new_offset(pp);
-  // We can go past the end of our chunk to finish a package's parsing
-  // in media res, but we can't go past the end of the actual map!
-  veryend = (const char *)pp->mem + pp->len;
-  while(offset < pp->len){
-    int newp;
-
-    start = (const char *)pp->mem + offset;
-    if(pp->csize + offset > pp->len){
-      end = start + (pp->len - offset);
-    }else{
-      end = start + pp->csize;
-    }
-    newp = lex_chunk(offset,start,end,veryend,&enq,pp);
-    if(newp < 0){
-      goto err;
+  arena_init(&ar);
+  r = EINVAL;
+  newp = lex_chunk(offset,start,end,veryend,&enq,&ar,pp);
+  if(newp > 0 && (pp->flags & RAPTORIAL_LEX_COLUMNAR)){
+    if((ts = tabulate_chunk(head,newp)) == NULL){
+      r = errno;
+      newp = -1;
     }
-    packages += newp;
-    offset = get_new_offset(pp);
+    arena_free(&ar);
+  // Deduplicated pkgobjs are kept whatever happened: other lists might
+  // already refer to them, and even a chunk whose every package lost its
+  // race (leaving head NULL) allocated those losers from ar.
+  }else if(pp->dedup == NULL && (newp < 0 || head == NULL)){
+    arena_free(&ar);
   }
-  if(head){
-    pthread_mutex_lock(&pp->lock); // Success!
-      if(pp->dfa && !filter){
+  pthread_mutex_lock(&pp->lock);
+    if(pp->dedup){
+      arena_splice(&pp->sharedpcache->arena,&ar);
+    }
+    if(newp < 0){
+      if(pp->err == 0){
+        pp->err = r;
+      }
+    }else if(ts){
+      pp->sharedpcache->pcount += newp;
+      ts->next = pp->sharedpcache->tsegs;
+      pp->sharedpcache->tsegs = ts;
+    }else if(head){ // Success!
+      if(pp->dfa && !pp->filter){
         for(po = head ; po ; po = po->next){
-          augment_dfa(pp->dfa,po->name,po);
+          augment_dfa_nstring(pp->dfa,po->name,po->namelen,po);
         }
       }
-      pp->sharedpcache->pcount += packages;
+      pp->sharedpcache->pcount += newp;
       *enq = pp->sharedpcache->pobjs;
       pp->sharedpcache->pobjs = head;
-    pthread_mutex_unlock(&pp->lock);
-  }
-  return vpp;
-
-err:
-  while( (po = head) ){
-    head = po->next;
-    free_package(po);
+      if(pp->dedup == NULL){
+        arena_splice(&pp->sharedpcache->arena,&ar);
+      }
+    }
+    if(pp->discard){
+      discard_chunks(pp,offset / pp->csize);
+    }
+    last = --pp->chunksleft == 0;
+    ret = pp->err;
+    if(pp->infd >= 0){
+      pthread_cond_signal(&pp->drained);
+    }
+  pthread_mutex_unlock(&pp->lock);
+  if(last && pp->dp){
+    return finish_dirlist(pp);
   }
-  return NULL;
+  return newp < 0 ? ret : 0;
 }
 
-struct dirparse {
-  DIR *dir;
-  struct dfa *dfa;
-  pkgcache *sharedpcache;
-  pthread_mutex_t lock;
-};
-
-static inline pkglist *
-create_pkglist(const void *mem,size_t len,int *err,int statusfile,struct dfa **dfa){
-  pkglist *pl;
+static int
+lex_chunk_task(workpool *wp __attribute__ ((unused)),void *vcp){
+  struct chunkparse *cp = vcp;
+  struct pkgparse *pp = cp->pp;
+  const char *start,*end,*veryend;
 
-  if((pl = malloc(sizeof(*pl))) == NULL){
-    *err = errno;
+  // We can go past the end of our chunk to finish a package's parsing
+  // in media res, but we can't go past the end of the actual map!
+  veryend = (const char *)pp->mem + pp->len;
+  start = (const char *)pp->mem + cp->offset;
+  if(pp->csize + cp->offset > pp->len){
+    end = start + (pp->len - cp->offset);
   }else{
-    struct pkgparse pp = {
-      .statusfile = statusfile,
-      .dfa = dfa,
-      .mem = mem,
-      .len = len,
-      .offset = 0,
-      .sharedpcache = pl,
-      .csize = 1024 * 1024,
-    };
-
-    memset(pl,0,sizeof(*pl));
-    if(lex_chunks(&pp) == NULL){
-      // FIXME set *err
-      free(pl);
-      return NULL;
-    }
+    end = start + pp->csize;
   }
-  return pl;
+  return lex_span(pp,cp->offset,start,end,veryend);
 }
 
-static inline pkgcache *
-create_pkgcache(pkglist *pl,int *err){
-  pkgcache *pc;
+// Segments are lexed whole; each begins and ends on a stanza boundary. Their
+// data is freed once lexed, unless the list's pkgobjs refer into it.
+static int
+lex_segment_task(workpool *wp __attribute__ ((unused)),void *vseg){
+  segment *seg = vseg;
+  struct pkgparse *pp = seg->pp;
+  int retain = pkglist_hasmap(pp->sharedpcache),r;
 
-  if((pc = malloc(sizeof(*pc))) == NULL){
-    *err = errno;
-  }else{
-    pc->lists = pl;
+  if(retain){ // link it before lex_span() can finish the list
+    pthread_mutex_lock(&pp->lock);
+      seg->next = pp->sharedpcache->segs;
+      pp->sharedpcache->segs = seg;
+    pthread_mutex_unlock(&pp->lock);
   }
-  return pc;
+  r = lex_span(pp,0,seg->data,seg->data + seg->len,seg->data + seg->len);
+  if(!retain){
+    free(seg);
+  }
+  return r;
 }
 
-static pkglist *
-lex_packages_file_internal(const char *path,int *err,int statusfile,
-            struct dfa **dfa){
-  const void *map;
-  size_t mlen;
-  pkglist *pl;
-  int fd;
+#define SEGMENT_SIZE (1024 * 1024)
 
-  if(path == NULL){
-    *err = EINVAL;
-    return NULL;
+static segment *
+alloc_segment(struct pkgparse *pp,size_t size){
+  segment *seg;
+
+  if( (seg = malloc(sizeof(*seg) + size)) ){
+    seg->next = NULL;
+    seg->pp = pp;
+    seg->len = 0;
+    seg->size = size;
+  }
+  return seg;
+}
+
+// Read the stream into the buffer, stopping short only at its end, after the
+// fashion of decomp_read().
+static int
+stream_read(struct pkgparse *pp,void *buf,size_t len,size_t *got,int *done){
+  ssize_t r;
+
+  if(pp->infd < 0){
+    return decomp_read(&pp->dc,buf,len,got,done);
+  }
+  *got = 0;
+  *done = 0;
+  while(*got < len){
+    if((r = read(pp->infd,(char *)buf + *got,len - *got)) < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      return errno;
+    }else if(r == 0){
+      *done = 1;
+      break;
+    }
+    *got += r;
+  }
+  return 0;
+}
+
+// Returns the length of the prefix of s ending in a double newline, or 0 if
+// there is no such prefix. We need only look back across one stanza.
+static size_t
+stanza_boundary(const char *s,size_t len){
+  while(len >= 2){
+    if(s[len - 1] == '\n' && s[len - 2] == '\n'){
+      return len;
+    }
+    --len;
+  }
+  return 0;
+}
+
+// Decompress (or read) the next segment of the list. Returns NULL at the end of the
+// stream, or on error (in which case the error is written through). A
+// segment is cut at its last stanza boundary, with the remainder carried
+// into the next; it grows if a single stanza won't fit.
+static segment *
+next_segment(struct pkgparse *pp,int *err){
+  size_t got,cut;
+  segment *seg;
+  int done;
+
+  *err = 0;
+  if(pp->streamdone){
+    return NULL;
   }
-  if((map = mapit(path,&mlen,&fd,1,err)) == MAP_FAILED){
+  pthread_mutex_lock(&pp->lock);
+    done = pp->err != 0; // don't bother producing for a failed list
+  pthread_mutex_unlock(&pp->lock);
+  if(done){
     return NULL;
   }
-  if((pl = create_pkglist(map,mlen,err,statusfile,dfa)) == NULL){
-    close(fd);
+  if((seg = pp->pending) == NULL){
+    if((seg = alloc_segment(pp,SEGMENT_SIZE)) == NULL){
+      *err = errno;
+      return NULL;
+    }
+  }
+  pp->pending = NULL;
+  for(;;){
+    if(seg->len == seg->size){
+      segment *tmp;
+
+      if((tmp = realloc(seg,sizeof(*seg) + seg->size * 2)) == NULL){
+        *err = errno;
+        free(seg);
+        return NULL;
+      }
+      seg = tmp;
+      seg->size *= 2;
+    }
+    if( (*err = stream_read(pp,seg->data + seg->len,seg->size - seg->len,&got,&done)) ){
+      free(seg);
+      return NULL;
+    }
+    seg->len += got;
+    if(done){
+      pp->streamdone = 1;
+      if(seg->len == 0){
+        free(seg);
+        return NULL;
+      }
+      return seg;
+    }
+    // stream_read() fills the segment unless the stream is done
+    if( (cut = stanza_boundary(seg->data,seg->len)) ){
+      break;
+    }
+  }
+  if((pp->pending = alloc_segment(pp,SEGMENT_SIZE)) == NULL){
+    *err = errno;
+    free(seg);
+    return NULL;
+  }
+  pp->pending->len = seg->len - cut;
+  memcpy(pp->pending->data,seg->data + cut,pp->pending->len);
+  seg->len = cut;
+  return seg;
+}
+
+// Called by the producer once the stream is exhausted (or has failed),
+// dropping its hold on the list.
+static int
+finish_stream(struct pkgparse *pp,int r){
+  unsigned last;
+
+  decomp_end(&pp->dc);
+  free(pp->pending);
+  pp->pending = NULL;
+  pthread_mutex_lock(&pp->lock);
+    if(r && pp->err == 0){
+      pp->err = r;
+    }
+    last = --pp->chunksleft == 0;
+  pthread_mutex_unlock(&pp->lock);
+  if(last && pp->dp){
+    r = finish_dirlist(pp);
+  }
+  return r;
+}
+
+// How many segments per worker a stream is read (or decompressed) ahead of
+// its lexers.
+#define STREAM_AHEAD 2
+
+// Produce one segment, decompressed (or read from a pooled call's fd). Before
+// lexing it ourselves (while it's hot in cache), we resubmit ourselves, so
+// that an idle worker can steal production of the next segment, overlapping
+// the two. Once as far ahead of the lexers as read_stream() may get, we
+// instead lex the segment before producing another, so we never wait on
+// them. Without a pool, we just loop.
+static int
+stream_task(workpool *wp,void *vpp){
+  unsigned ahead = wp ? 1 + STREAM_AHEAD * wp->workers : 0;
+  struct pkgparse *pp = vpp;
+  segment *seg;
+  int r,resubmit;
+
+  for(;;){
+    if((seg = next_segment(pp,&r)) == NULL){
+      return finish_stream(pp,r);
+    }
+    // Count the segment before the producer can drop its hold
+    pthread_mutex_lock(&pp->lock);
+      // chunksleft counts our hold, and the segments not yet lexed
+      resubmit = ++pp->chunksleft <= ahead;
+    pthread_mutex_unlock(&pp->lock);
+    if(resubmit && workpool_submit(wp,stream_task,pp) == 0){
+      return lex_segment_task(wp,seg);
+    }
+    lex_segment_task(wp,seg); // errors are collected in pp->err
+  }
+}
+
+struct streamread {
+  workpool *wp;
+  struct pkgparse *pp;
+  unsigned ahead; // segments which may await lexing at once
+};
+
+// Read the list from its fd as segments, handing each to the pool once it
+// has room, so that a fast reader doesn't buffer a whole stream. Without a
+// pool, we just loop.
+static int
+read_stream(workpool *wp,struct pkgparse *pp,unsigned ahead){
+  segment *seg;
+  int r;
+
+  for(;;){
+    if((seg = next_segment(pp,&r)) == NULL){
+      return finish_stream(pp,r);
+    }
+    pthread_mutex_lock(&pp->lock);
+      // chunksleft counts our hold, and the segments not yet lexed
+      while(wp && pp->chunksleft > ahead && pp->err == 0){
+        pthread_cond_wait(&pp->drained,&pp->lock);
+      }
+      ++pp->chunksleft;
+    pthread_mutex_unlock(&pp->lock);
+    if(wp == NULL || workpool_submit(wp,lex_segment_task,seg)){
+      lex_segment_task(wp,seg); // errors are collected in pp->err
+    }
+  }
+}
+
+// Without a pool, the reader gets a thread of its own, rather than a task,
+// so that a worker isn't left blocked on a pipe while there's lexing to be
+// done.
+static void *
+read_stream_thread(void *vsr){
+  struct streamread *sr = vsr;
+
+  read_stream(sr->wp,sr->pp,sr->ahead); // errors are collected in pp->err
+  workpool_release(sr->wp);
+  return NULL;
+}
+
+// Errors are collected in pp->err. A pooled call creates no threads, so the
+// pool's workers read the fd through stream_task(), one of them at a time
+// perhaps blocked on it.
+static void
+stream_pkglist(struct pkgparse *pp,unsigned threads,struct raptorial_pool *rp){
+  struct streamread sr;
+  pthread_t tid;
+  workpool wp;
+  int r;
+
+  if(workpool_init(&wp,threads,rp)){
+    read_stream(NULL,pp,0);
+    return;
+  }
+  if(rp){
+    if((r = workpool_submit(&wp,stream_task,pp)) == 0){
+      workpool_run(&wp,&r);
+    }
+    workpool_destroy(&wp);
+    if(r){
+      pthread_mutex_lock(&pp->lock);
+        if(pp->err == 0){
+          pp->err = r;
+        }
+      pthread_mutex_unlock(&pp->lock);
+    }
+    return;
+  }
+  sr.wp = &wp;
+  sr.pp = pp;
+  sr.ahead = 1 + STREAM_AHEAD * wp.workers;
+  workpool_hold(&wp);
+  if(pthread_create(&tid,NULL,read_stream_thread,&sr)){
+    workpool_destroy(&wp);
+    read_stream(NULL,pp,0);
+    return;
+  }
+  if(workpool_run(&wp,&r)){
+    // Stop the reader, lest it wait on workers which never ran.
+    pthread_mutex_lock(&pp->lock);
+      if(pp->err == 0){
+        pp->err = r;
+      }
+      pthread_cond_signal(&pp->drained);
+    pthread_mutex_unlock(&pp->lock);
+  }
+  pthread_join(tid,NULL);
+  workpool_destroy(&wp);
+}
+
+// Chunks are sized so that each thread can expect several of them (evening
+// out the tail of the run), but never so small that the overlap lexed twice at
+// either end of a chunk becomes significant.
+#define CHUNK_MIN (256 * 1024)
+#define CHUNK_MAX (1024 * 1024)
+#define CHUNKS_PER_THREAD 4
+
+static size_t
+chunk_size(size_t len,unsigned threads){
+  size_t csize;
+
+  csize = len / ((size_t)threads * CHUNKS_PER_THREAD);
+  if(csize < CHUNK_MIN){
+    csize = CHUNK_MIN;
+  }else if(csize > CHUNK_MAX){
+    csize = CHUNK_MAX;
+  }
+  return csize;
+}
+
+static void
+free_pkgparse(struct pkgparse *pp){
+  pthread_mutex_destroy(&pp->lock);
+  if(pp->infd >= 0){
+    pthread_cond_destroy(&pp->drained);
+  }
+  if(pp->comp != COMP_NONE || pp->infd >= 0){
+    decomp_end(&pp->dc);
+    free(pp->pending);
+  }
+  free(pp->cparse);
+}
+
+// Prepare pp to lex the len bytes at mem into a new pkglist, broken into
+// chunks appropriate for threads workers. If comp is not COMP_NONE, mem
+// is instead decompressed, and lexed as a stream of segments. If infd is
+// not -1, the list is instead read from it, also as a stream of segments.
+static int
+init_pkgparse(struct pkgparse *pp,const void *mem,size_t len,int statusfile,
+              struct dfa **dfa,unsigned threads,unsigned flags,
+              const fieldtab *ft,compkind comp,int infd){
+  unsigned z,chunks;
+  pkglist *pl;
+  int r;
+
+  memset(pp,0,sizeof(*pp));
+  pp->mem = mem;
+  pp->len = len;
+  pp->statusfile = statusfile;
+  pp->flags = flags;
+  pp->ft = ft;
+  pp->dfa = dfa;
+  pp->filter = dfa && *dfa ? 1 : 0;
+  pp->fd = -1;
+  pp->infd = infd;
+  if(infd >= 0){
+    pp->chunksleft = 1; // the reader's hold
+  }else if(comp != COMP_NONE){
+    if( (r = decomp_init(&pp->dc,comp,mem,len)) ){
+      return r;
+    }
+    pp->comp = comp;
+    pp->chunksleft = 1; // the producer's hold
+  }else{
+    pp->csize = chunk_size(len,threads);
+    chunks = len / pp->csize + (len % pp->csize ? 1 : 0);
+    if(chunks == 0){
+      chunks = 1; // lex_chunk() handles an empty map
+    }
+    if((pp->cparse = malloc(sizeof(*pp->cparse) * chunks)) == NULL){
+      return errno;
+    }
+    for(z = 0 ; z < chunks ; ++z){
+      pp->cparse[z].pp = pp;
+      pp->cparse[z].offset = (size_t)z * pp->csize;
+      pp->cparse[z].lexed = 0;
+    }
+    pp->chunksleft = pp->chunks = chunks;
+  }
+  if((pp->sharedpcache = malloc(sizeof(*pp->sharedpcache))) == NULL){
+    r = errno;
+    decomp_end(&pp->dc);
+    free(pp->cparse);
+    return r;
+  }
+  pl = pp->sharedpcache;
+  memset(pl,0,sizeof(*pl));
+  arena_init(&pl->arena);
+  pl->flags = flags;
+  // The list keeps its own copy of the captured fields' names.
+  if(ft->nfields){
+    if((pl->fields = arena_alloc(&pl->arena,sizeof(*pl->fields) * ft->nfields)) == NULL){
+      r = errno;
+      free_package_list(pl);
+      decomp_end(&pp->dc);
+      free(pp->cparse);
+      return r;
+    }
+    for(z = 0 ; z < ft->nfields ; ++z){
+      size_t flen = strlen(ft->fields[z]) + 1;
+      char *f;
+
+      if((f = arena_alloc(&pl->arena,flen)) == NULL){
+        r = errno;
+        free_package_list(pl);
+        decomp_end(&pp->dc);
+        free(pp->cparse);
+        return r;
+      }
+      pl->fields[z] = memcpy(f,ft->fields[z],flen);
+    }
+    pl->nfields = ft->nfields;
+  }
+  if( (r = pthread_mutex_init(&pp->lock,NULL)) ){
+    free_package_list(pl);
+    decomp_end(&pp->dc);
+    free(pp->cparse);
+    return r;
+  }
+  if(infd >= 0 && (r = pthread_cond_init(&pp->drained,NULL))){
+    pthread_mutex_destroy(&pp->lock);
+    free_package_list(pl);
+    return r;
+  }
+  return 0;
+}
+
+// Submit chunks first and beyond. Chunks which couldn't be submitted are
+// counted as failed.
+static void
+submit_chunks(workpool *wp,struct pkgparse *pp,unsigned first){
+  unsigned z,chunks = pp->chunksleft;
+  int r;
+
+  for(z = first ; z < chunks ; ++z){
+    if( (r = workpool_submit(wp,lex_chunk_task,&pp->cparse[z])) ){
+      pthread_mutex_lock(&pp->lock);
+        pp->chunksleft -= chunks - z;
+        if(pp->err == 0){
+          pp->err = r;
+        }
+      pthread_mutex_unlock(&pp->lock);
+      break;
+    }
+  }
+}
+
+// The pkgobjs needn't be walked; this is one free() per arena block.
+static void
+free_pkgobjs(pkglist *pl){
+  tableseg *ts;
+  segment *seg;
+
+  arena_free(&pl->arena);
+  pl->pobjs = NULL;
+  pl->pcount = 0;
+  while( (seg = pl->segs) ){
+    pl->segs = seg->next;
+    free(seg);
+  }
+  while( (ts = pl->tsegs) ){
+    pl->tsegs = ts->next;
+    tableseg_free(ts);
+  }
+}
+
+// threads bounds the parallelism used within this one list. With a pool,
+// even a list lexed in one chunk is lexed on it, off the calling thread.
+static inline pkglist *
+create_pkglist(const void *mem,size_t len,int *err,int statusfile,
+                struct dfa **dfa,unsigned threads,unsigned flags,
+                const fieldtab *ft,compkind comp,int infd,
+                struct raptorial_pool *rp){
+  struct pkgparse pp;
+  workpool wp;
+  pkglist *pl;
+  int r;
+
+  if(infd < 0){ // a stream's length isn't known up front
+    unsigned want = threads_for_bytes(rp,comp == COMP_NONE ? len : len * COMP_RATIO);
+
+    if(threads > want){
+      threads = want;
+    }
+  }
+  if( (r = init_pkgparse(&pp,mem,len,statusfile,dfa,threads,flags,ft,comp,infd)) ){
+    *err = r;
+    return NULL;
+  }
+  pp.sharedpcache->rpool = rp;
+  if(infd >= 0){
+    stream_pkglist(&pp,threads,rp);
+    r = 0;
+  // Without a pool, don't bother with threads for a map lexed in one chunk.
+  }else if(rp || (threads > 1 && (comp != COMP_NONE || pp.chunksleft > 1))){
+    if( (r = workpool_init(&wp,threads,rp)) == 0){
+      if(comp != COMP_NONE){
+        r = workpool_submit(&wp,stream_task,&pp);
+      }else{
+        submit_chunks(&wp,&pp,0);
+      }
+      if(r == 0){
+        workpool_run(&wp,&r);
+      }
+      workpool_destroy(&wp);
+    }
+  }else if(comp != COMP_NONE){
+    stream_task(NULL,&pp);
+    r = 0;
+  }else{
+    unsigned z,chunks = pp.chunksleft;
+
+    for(z = 0 ; z < chunks ; ++z){
+      lex_chunk_task(NULL,&pp.cparse[z]);
+    }
+    r = 0;
+  }
+  pl = pp.sharedpcache;
+  if(r == 0){
+    r = pp.err;
+  }
+  free_pkgparse(&pp);
+  if(r){
+    *err = r;
+    free_package_list(pl);
+    return NULL;
+  }
+  return pl;
+}
+
+static inline pkgcache *
+create_pkgcache(pkglist *pl,int *err){
+  pkgcache *pc;
+
+  if((pc = malloc(sizeof(*pc))) == NULL){
+    *err = errno;
+  }else{
+    memset(pc,0,sizeof(*pc));
+    pc->lists = pl;
+  }
+  return pc;
+}
+
+// Each pkgobj is indexed by exactly one task.
+static void
+set_nameid(const void *vpo,uint32_t id){
+  ((pkgobj *)vpo)->nameid = id;
+}
+
+// Index the packages of every list by name, on the cache's pool if it has one,
+// and number their names.
+static int
+index_pkgcache(pkgcache *pc){
+  const pkglist *pl;
+  const pkgobj *po;
+  size_t count,z;
+  nameent *ents;
+
+  count = 0;
+  for(pl = pc->lists ; pl ; pl = pl->next){
+    count += pl->pcount;
+  }
+  if((ents = malloc(sizeof(*ents) * (count ? count : 1))) == NULL){
+    return errno;
+  }
+  z = 0;
+  for(pl = pc->lists ; pl ; pl = pl->next){
+    for(po = pl->pobjs ; po ; po = po->next){
+      ents[z].name = po->name;
+      ents[z].len = po->namelen;
+      ents[z].obj = po;
+      ++z;
+    }
+  }
+  return nameindex_build(&pc->idx,ents,count,threadpool_width(pc->opts.pool),
+                         pc->opts.pool,set_nameid);
+}
+
+// Gather the tablesegs of every list into the cache's table. List ids follow
+// the order of pc->lists.
+static int
+tabulate_pkgcache(pkgcache *pc){
+  const pkglist **lists;
+  unsigned nlists,z;
+  tableseg **segs;
+  pkglist *pl;
+  int r = 0;
+
+  nlists = 0;
+  for(pl = pc->lists ; pl ; pl = pl->next){
+    ++nlists;
+  }
+  lists = malloc(sizeof(*lists) * (nlists ? nlists : 1));
+  segs = malloc(sizeof(*segs) * (nlists ? nlists : 1));
+  if(lists == NULL || segs == NULL){
+    r = errno;
+    free(lists);
+    free(segs);
+    return r;
+  }
+  for(z = 0, pl = pc->lists ; pl ; pl = pl->next, ++z){
+    lists[z] = pl;
+    segs[z] = pl->tsegs;
+  }
+  if((pc->table = pkgtable_create(lists,segs,nlists,&r)) != NULL){
+    for(pl = pc->lists ; pl ; pl = pl->next){
+      pl->tsegs = NULL;
+    }
+  }
+  free(lists);
+  free(segs);
+  return r;
+}
+
+// RAPTORIAL_LEX_COLUMNAR lists have no pkgobjs to index, capture fields in,
+// or build a dfa from.
+static int
+check_columnar(unsigned flags,const char * const *fields,int building){
+  if(flags & RAPTORIAL_LEX_COLUMNAR){
+    if((flags & ~RAPTORIAL_LEX_COLUMNAR) || fields || building){
+      return EINVAL;
+    }
+  }
+  return 0;
+}
+
+// Zero-copy and field-retaining lists keep their mapping until they're
+// freed; otherwise, we're done with it once the list has been lexed.
+static void
+adopt_map(pkglist *pl,const void *map,size_t len){
+  if(pkglist_hasmap(pl)){
+    pl->map = map;
+    pl->maplen = len;
+  }else{
+    munmap((void *)map,len);
+  }
+}
+
+static inline unsigned
+lexopts_flags(const raptorial_lexopts *opts){
+  return opts ? opts->flags : 0;
+}
+
+static inline raptorial_io
+lexopts_io(const raptorial_lexopts *opts){
+  return opts ? opts->io : RAPTORIAL_IO_POPULATE;
+}
+
+static inline const char * const *
+lexopts_fields(const raptorial_lexopts *opts){
+  return opts ? opts->fields : NULL;
+}
+
+static inline struct raptorial_pool *
+lexopts_pool(const raptorial_lexopts *opts){
+  return opts ? opts->pool : NULL;
+}
+
+// If cb is non-NULL, it's handed each stanza, and the list is left empty.
+static pkglist *
+lex_packages_file_internal(const char *path,int *err,int statusfile,
+            struct dfa **dfa,unsigned threads,const raptorial_lexopts *opts,
+            raptorial_stanzacb cb,void *opaque){
+  const void *map;
+  size_t mlen,slen;
+  compkind comp;
+  fieldtab ft;
+  pkglist *pl;
+  int fd,r;
+
+  if(path == NULL){
+    *err = EINVAL;
+    return NULL;
+  }
+  if( (r = check_columnar(lexopts_flags(opts),lexopts_fields(opts),
+                          dfa && *dfa == NULL)) ){
+    *err = r;
+    return NULL;
+  }
+  if((comp = comp_from_name(path,&slen)) == COMP_UNSUPPORTED){
+    *err = ENOTSUP;
+    return NULL;
+  }
+  if( (r = init_fieldtab(&ft,lexopts_fields(opts))) ){
+    *err = r;
+    return NULL;
+  }
+  ft.cb = cb;
+  ft.opaque = opaque;
+  if((map = mapit(AT_FDCWD,path,&mlen,&fd,lexopts_io(opts),err)) == MAP_FAILED){
+    free_fieldtab(&ft);
     return NULL;
   }
   close(fd);
+  pl = create_pkglist(map,mlen,err,statusfile,dfa,threads,
+                      lexopts_flags(opts),&ft,comp,-1,lexopts_pool(opts));
+  free_fieldtab(&ft);
+  if(pl == NULL || comp != COMP_NONE){ // we're done with compressed data
+    munmap((void *)map,mlen);
+  }else{
+    adopt_map(pl,map,mlen);
+  }
+  return pl;
+}
+
+// The fd is read through to its end, but neither rewound nor closed.
+static pkglist *
+lex_fd_internal(int fd,int *err,int statusfile,struct dfa **dfa,
+                unsigned threads,const raptorial_lexopts *opts){
+  fieldtab ft;
+  pkglist *pl;
+  int r;
+
+  if(fd < 0){
+    *err = EBADF;
+    return NULL;
+  }
+  if( (r = check_columnar(lexopts_flags(opts),lexopts_fields(opts),
+                          dfa && *dfa == NULL)) ){
+    *err = r;
+    return NULL;
+  }
+  if( (r = init_fieldtab(&ft,lexopts_fields(opts))) ){
+    *err = r;
+    return NULL;
+  }
+  pl = create_pkglist(NULL,0,err,statusfile,dfa,threads,
+                      lexopts_flags(opts),&ft,COMP_NONE,fd,lexopts_pool(opts));
+  free_fieldtab(&ft);
   return pl;
 }
 
+PUBLIC pkglist *
+lex_packages_fd(int fd,int *err,struct dfa **dfa){
+  return lex_fd_internal(fd,err,0,dfa,online_pes(),NULL);
+}
+
+PUBLIC pkglist *
+lex_packages_fd_opts(int fd,int *err,struct dfa **dfa,
+                     const raptorial_lexopts *opts){
+  return lex_fd_internal(fd,err,0,dfa,threadpool_width(lexopts_pool(opts)),
+                         opts);
+}
+
+PUBLIC pkglist *
+lex_status_fd(int fd,int *err,struct dfa **dfa){
+  return lex_fd_internal(fd,err,1,dfa,online_pes(),NULL);
+}
+
+PUBLIC pkglist *
+lex_status_fd_opts(int fd,int *err,struct dfa **dfa,
+                   const raptorial_lexopts *opts){
+  return lex_fd_internal(fd,err,1,dfa,threadpool_width(lexopts_pool(opts)),
+                         opts);
+}
+
 PUBLIC pkglist *
 lex_packages_file(const char *path,int *err,struct dfa **dfa){
-  return lex_packages_file_internal(path,err,0,dfa);
+  return lex_packages_file_internal(path,err,0,dfa,online_pes(),NULL,NULL,NULL);
+}
+
+PUBLIC pkglist *
+lex_packages_file_opts(const char *path,int *err,struct dfa **dfa,
+                       const raptorial_lexopts *opts){
+  return lex_packages_file_internal(path,err,0,dfa,
+                   threadpool_width(lexopts_pool(opts)),opts,NULL,NULL);
+}
+
+PUBLIC int
+lex_packages_file_cb_opts(const char *path,const raptorial_lexopts *opts,
+                          raptorial_stanzacb cb,void *opaque,int *err){
+  const raptorial_lexopts cbopts = {
+    .fields = lexopts_fields(opts),
+    .io = lexopts_io(opts),
+    .pool = lexopts_pool(opts),
+  };
+  pkglist *pl;
+
+  if(cb == NULL){
+    *err = EINVAL;
+    return -1;
+  }
+  if((pl = lex_packages_file_internal(path,err,0,NULL,
+                                      threadpool_width(cbopts.pool),&cbopts,
+                                      cb,opaque)) == NULL){
+    return -1;
+  }
+  free_package_list(pl);
+  return 0;
+}
+
+PUBLIC int
+lex_packages_file_cb(const char *path,const char * const *fields,
+                     raptorial_stanzacb cb,void *opaque,int *err){
+  const raptorial_lexopts opts = { .fields = fields, };
+
+  return lex_packages_file_cb_opts(path,&opts,cb,opaque,err);
+}
+
+PUBLIC unsigned
+raptorial_workers(void){
+  return online_pes();
 }
 
 PUBLIC void
 free_package_list(pkglist *pl){
   if(pl){
+    free_pkgobjs(pl);
+    if(pl->map){
+      munmap((void *)pl->map,pl->maplen);
+    }
     free(pl->distribution);
     free(pl->arch);
+    free(pl->component);
+    free(pl->path);
     free(pl->uri);
     free(pl);
   }
@@ -477,11 +1702,27 @@ PUBLIC pkgcache *
 pkgcache_from_pkglist(pkglist *pl,int *err){
   pkgcache *pc;
 
+  int r;
+
   if(pl == NULL){
     return NULL;
   }
   if((pc = create_pkgcache(pl,err)) == NULL){
     free_package_list(pl);
+    return NULL;
+  }
+  pc->opts.pool = pl->rpool; // index on the pool which lexed the list
+  if(pl->flags & (RAPTORIAL_LEX_INDEX | RAPTORIAL_LEX_COLUMNAR)){
+    if(pl->flags & RAPTORIAL_LEX_INDEX){
+      r = index_pkgcache(pc);
+    }else{
+      r = tabulate_pkgcache(pc);
+    }
+    if(r){
+      *err = r;
+      free_package_cache(pc);
+      pc = NULL;
+    }
   }
   return pc;
 }
@@ -495,13 +1736,23 @@ free_package_cache(pkgcache *pc){
       pc->lists = pl->next;
       free_package_list(pl);
     }
+    nameindex_free(&pc->idx);
+    pkgtable_free(pc->table);
+    free(pc->byid);
     free(pc);
   }
 }
 
 PUBLIC pkglist *
 lex_status_file(const char *path,int *err,struct dfa **dfa){
-  return lex_packages_file_internal(path,err,1,dfa);
+  return lex_packages_file_internal(path,err,1,dfa,online_pes(),NULL,NULL,NULL);
+}
+
+PUBLIC pkglist *
+lex_status_file_opts(const char *path,int *err,struct dfa **dfa,
+                     const raptorial_lexopts *opts){
+  return lex_packages_file_internal(path,err,1,dfa,
+                   threadpool_width(lexopts_pool(opts)),opts,NULL,NULL);
 }
 
 PUBLIC const pkglist *
@@ -514,175 +1765,1220 @@ pkgcache_next(const pkglist *pl){
   return pl->next;
 }
 
-PUBLIC const char *
-pkglist_uri(const pkglist *pl){
-  return pl->uri;
+PUBLIC const char *
+pkglist_uri(const pkglist *pl){
+  return pl->uri;
+}
+
+PUBLIC const pkgobj *
+pkglist_begin(const pkglist *pl){
+  return pl->pobjs;
+}
+
+PUBLIC const pkgobj *
+pkglist_next(const pkgobj *po){
+  return po->next;
+}
+
+// Stub packages have no list, and are never views.
+static inline int
+pkgobj_isview(const pkgobj *po){
+  return po->pl && (po->pl->flags & RAPTORIAL_LEX_ZEROCOPY);
+}
+
+PUBLIC const char *
+pkgobj_name(const pkgobj *po){
+  return pkgobj_isview(po) ? NULL : po->name;
+}
+
+PUBLIC const char *
+pkgobj_nameview(const pkgobj *po,size_t *len){
+  *len = po->namelen;
+  return po->name;
+}
+
+PUBLIC const char *
+pkglist_dist(const pkglist *pl){
+  return pl->distribution;
+}
+
+PUBLIC const char *
+pkglist_arch(const pkglist *pl){
+  return pl->arch;
+}
+
+PUBLIC const char *
+pkglist_component(const pkglist *pl){
+  return pl->component;
+}
+
+PUBLIC const char *
+pkgobj_version(const pkgobj *po){
+  return pkgobj_isview(po) ? NULL : po->version;
+}
+
+PUBLIC const char *
+pkgobj_versionview(const pkgobj *po,size_t *len){
+  *len = po->verlen;
+  return po->version;
+}
+
+PUBLIC const char *
+pkgobj_captured(const pkgobj *po,unsigned idx,size_t *len){
+  const fieldview *fv = (const fieldview *)(po + 1);
+
+  if(po->pl == NULL || idx >= po->pl->nfields || fv[idx].val == NULL){
+    return NULL;
+  }
+  *len = fv[idx].len;
+  return fv[idx].val;
+}
+
+// Captured fields are returned directly. Otherwise, fields are only parsed
+// when asked for, by walking the lines of the stanza. A field runs from its
+// tag through any continuation lines (those beginning with whitespace), less
+// the whitespace following the colon and the final newline. Tags are matched
+// without regard to case, as dpkg does.
+PUBLIC const char *
+pkgobj_field(const pkgobj *po,const char *field,size_t *len){
+  const char *c,*eol,*end,*val;
+  size_t flen = strlen(field);
+  linescan ls;
+  unsigned z;
+
+  if(po->pl == NULL){
+    return NULL;
+  }
+  for(z = 0 ; z < po->pl->nfields ; ++z){
+    if(strcasecmp(po->pl->fields[z],field) == 0){
+      return pkgobj_captured(po,z,len);
+    }
+  }
+  if(!pkglist_hasmap(po->pl) || po->stanza == NULL){
+    return NULL;
+  }
+  end = po->stanza + po->stanzalen;
+  linescan_init(&ls,po->stanza,end);
+  for(c = po->stanza ; c < end ; c = eol + 1){
+    eol = linescan_next(&ls);
+    if((size_t)(eol - c) <= flen || c[flen] != ':' || strncasecmp(c,field,flen)){
+      continue;
+    }
+    for(val = c + flen + 1 ; val < eol && isspace(*val) ; ++val){
+      ;
+    }
+    while(eol + 1 < end && (eol[1] == ' ' || eol[1] == '\t')){
+      eol = linescan_next(&ls);
+    }
+    *len = eol - val;
+    return val;
+  }
+  return NULL;
+}
+
+// debcmp() wants NUL-terminated versions, which views aren't.
+static int
+pkgobj_vercmp(const pkgobj *p1,const pkgobj *p2){
+  if(pkgobj_isview(p1) || pkgobj_isview(p2)){
+    char v1[p1->verlen + 1],v2[p2->verlen + 1];
+
+    memcpy(v1,p1->version,p1->verlen);
+    v1[p1->verlen] = '\0';
+    memcpy(v2,p2->version,p2->verlen);
+    v2[p2->verlen] = '\0';
+    return debcmp(v1,v2);
+  }
+  return debcmp(p1->version,p2->version);
+}
+
+PUBLIC unsigned
+pkgcache_count(const pkgcache *pc){
+  unsigned tot = 0;
+
+  if(pc){
+    pkglist *pl;
+
+    for(pl = pc->lists ; pl ; pl = pl ->next){
+      tot += pl->pcount;
+    }
+  }
+  return tot;
+}
+
+// The index returns spans of its objects, which are our pkgobjs.
+static inline size_t
+index_span(const pkgcache *pc,size_t first,size_t n,const pkgobj * const **pkgs){
+  *pkgs = (const pkgobj * const *)pc->idx.objs + first;
+  return n;
+}
+
+PUBLIC int
+pkgcache_add_list(pkgcache *pc,pkglist *pl,int *err){
+  int indexed = pc->idx.slots != NULL;
+  int r;
+
+  if(pc->table){
+    *err = EINVAL;
+    return -1;
+  }
+  if(pc->byid){
+    pkglist **byid,*sib;
+
+    if((byid = realloc(pc->byid,sizeof(*byid) * (pc->nlists + 1))) == NULL){
+      *err = errno;
+      return -1;
+    }
+    pc->byid = byid;
+    pl->listid = pc->nlists;
+    byid[pc->nlists++] = pl;
+    for(sib = pc->lists ; sib ; sib = sib->next){
+      sib->siblings = byid;
+    }
+    pl->siblings = byid;
+  }
+  pl->next = pc->lists;
+  pc->lists = pl;
+  if(indexed){
+    nameindex_free(&pc->idx);
+    if( (r = index_pkgcache(pc)) ){
+      *err = r;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+PUBLIC unsigned
+pkgobj_nameid(const pkgobj *po){
+  return po->nameid;
+}
+
+PUBLIC unsigned
+pkgcache_names(const pkgcache *pc){
+  return pc->idx.names;
+}
+
+PUBLIC const char *
+pkgcache_idname(const pkgcache *pc,unsigned id,size_t *len){
+  const nameent *ne;
+
+  if(id >= pc->idx.names){
+    return NULL;
+  }
+  ne = &pc->idx.ents[pc->idx.first[id]];
+  *len = ne->len;
+  return ne->name;
+}
+
+PUBLIC unsigned
+pkgcache_nameid(const pkgcache *pc,const char *name){
+  int64_t id = nameindex_id(&pc->idx,name,strlen(name));
+
+  return id < 0 ? RAPTORIAL_NONAMEID : (unsigned)id;
+}
+
+// Sets are built as a dense bitmap over the cache's name ids, which is then
+// compressed. Returns NULL if the cache wasn't indexed.
+static uint64_t *
+alloc_namebits(const pkgcache *pc,int *err){
+  uint64_t *bits;
+
+  if(pc->idx.slots == NULL){
+    *err = EINVAL;
+    return NULL;
+  }
+  if((bits = calloc(pc->idx.names / 64 + 1,sizeof(*bits))) == NULL){
+    *err = errno;
+  }
+  return bits;
+}
+
+static inline void
+set_namebit(uint64_t *bits,uint32_t id){
+  bits[id / 64] |= 1ull << (id % 64);
+}
+
+static pkgset *
+finish_namebits(const pkgcache *pc,uint64_t *bits,int *err){
+  pkgset *ps = pkgset_from_bitmap(bits,pc->idx.names,err);
+
+  free(bits);
+  return ps;
+}
+
+PUBLIC pkgset *
+pkgset_from_list(const pkgcache *pc,const pkglist *pl,int *err){
+  const pkglist *sib;
+  const pkgobj *po;
+  uint64_t *bits;
+  size_t z;
+
+  // Only our own lists' names (and list ids) index our bitmaps.
+  for(sib = pc->lists ; sib != pl ; sib = sib->next){
+    if(sib == NULL){
+      *err = EINVAL;
+      return NULL;
+    }
+  }
+  if((bits = alloc_namebits(pc,err)) == NULL){
+    return NULL;
+  }
+  if(pl->origwords == 0){
+    for(po = pl->pobjs ; po ; po = po->next){
+      if(po->nameid < pc->idx.names){ // unnumbered if never indexed
+        set_namebit(bits,po->nameid);
+      }
+    }
+  }else{ // our packages might belong to other lists
+    for(z = 0 ; z < pc->idx.count ; ++z){
+      const origins *o;
+
+      po = pc->idx.objs[z];
+      if( (o = pkgobj_origins(po)) ){
+        if(po->nameid < pc->idx.names &&
+            (atomic_load_explicit(&o->bits[pl->listid / 64],memory_order_relaxed)
+            & (1ull << (pl->listid % 64)))){
+          set_namebit(bits,po->nameid);
+        }
+      }
+    }
+  }
+  return finish_namebits(pc,bits,err);
+}
+
+PUBLIC pkgset *
+pkgset_from_dfa(const pkgcache *pc,const struct dfa *dfa,int *err){
+  uint64_t *bits;
+  dfactx dctx;
+  size_t id;
+
+  if((bits = alloc_namebits(pc,err)) == NULL){
+    return NULL;
+  }
+  for(id = 0 ; dfa && id < pc->idx.names ; ++id){
+    const nameent *ne = &pc->idx.ents[pc->idx.first[id]];
+
+    init_dfactx(&dctx,dfa);
+    if(match_dfactx_nstring(&dctx,ne->name,ne->len)){
+      set_namebit(bits,id);
+    }
+  }
+  return finish_namebits(pc,bits,err);
+}
+
+PUBLIC pkgset *
+pkgset_from_pkgobjs(const pkgcache *pc,int (*pred)(const pkgobj *,void *),
+                    void *arg,int *err){
+  uint64_t *bits;
+  size_t z;
+
+  if((bits = alloc_namebits(pc,err)) == NULL){
+    return NULL;
+  }
+  for(z = 0 ; z < pc->idx.count ; ++z){
+    const pkgobj *po = pc->idx.objs[z];
+
+    if(pred(po,arg)){
+      set_namebit(bits,po->nameid);
+    }
+  }
+  return finish_namebits(pc,bits,err);
+}
+
+PUBLIC const pkgtable *
+pkgcache_table(const pkgcache *pc){
+  return pc->table;
+}
+
+PUBLIC size_t
+pkgcache_lookup(const pkgcache *pc,const char *name,const pkgobj * const **pkgs){
+  size_t first,n;
+
+  n = nameindex_lookup(&pc->idx,name,strlen(name),&first);
+  return n ? index_span(pc,first,n,pkgs) : 0;
+}
+
+PUBLIC size_t
+pkgcache_prefix(const pkgcache *pc,const char *prefix,const pkgobj * const **pkgs){
+  size_t first,n;
+
+  n = nameindex_prefix(&pc->idx,prefix,strlen(prefix),&first);
+  return n ? index_span(pc,first,n,pkgs) : 0;
+}
+
+PUBLIC size_t
+pkgcache_range(const pkgcache *pc,const char *lo,const char *hi,
+               const pkgobj * const **pkgs){
+  size_t first,n;
+
+  n = nameindex_range(&pc->idx,lo,strlen(lo),hi,hi ? strlen(hi) : 0,&first);
+  return n ? index_span(pc,first,n,pkgs) : 0;
+}
+
+struct dirparse {
+  int dirfd; // the lists' directory, against which their names are opened
+  struct dfa *dfa;
+  unsigned threads;
+  unsigned flags; // RAPTORIAL_LEX_*
+  raptorial_io io;
+  const fieldtab *ft;
+  deduptab *dedup; // NULL unless RAPTORIAL_LEX_DEDUP
+  int keepfailed; // failed lists are kept, marked stale, rather than freed
+  pthread_mutex_t lock; // protects sharedpcache, and the lists below
+  pkgcache *sharedpcache;
+  // Lists are submitted largest first, but under a memory budget, only while
+  // the bytes of those submitted and unfinished fit within it (a list larger
+  // than the budget is submitted alone). Finishing a list submits more.
+  workpool *wp;
+  struct listfile *lfs;
+  unsigned count,nextlist;
+  size_t budget,resident;
+};
+
+// One list of a directory, to be lexed as a task. Every list is stat()ed
+// before anything is scheduled, so that the largest lists can be split first.
+struct listfile {
+  struct dirparse *dp;
+  char *name;    // handed off to the list once it's created,
+  listmeta meta; // as is this
+  struct stat st;
+  compkind comp;
+  unsigned listid;
+  void *buf;     // the list's contents, if read ahead through io_uring
+  size_t buflen;
+};
+
+static int lex_file_task(workpool *,void *);
+
+// The bytes we expect to lex from a list, and hold while doing so: a
+// compressed list's decompressed size is estimated from its own.
+static inline size_t
+list_charge(const struct stat *st,compkind comp){
+  return st->st_size * (comp == COMP_NONE ? 1 : COMP_RATIO);
+}
+
+// Populating a mapping would make the whole list resident before any of it
+// could be discarded, so under a budget, lists are mapped lazily.
+static inline raptorial_io
+list_io(const struct dirparse *dp){
+  if(dp->budget && (dp->io == RAPTORIAL_IO_POPULATE ||
+                    dp->io == RAPTORIAL_IO_HUGEPAGE)){
+    return RAPTORIAL_IO_LAZY;
+  }
+  return dp->io;
+}
+
+// Submit whichever further lists fit within the budget. Returns 0, or the
+// error with which a submission failed, in which case the remaining lists
+// are abandoned.
+static int
+submit_lists(struct dirparse *dp){
+  int r = 0;
+
+  pthread_mutex_lock(&dp->lock);
+    while(dp->nextlist < dp->count){
+      struct listfile *lf = &dp->lfs[dp->nextlist];
+
+      if(dp->budget && dp->resident &&
+          dp->resident + list_charge(&lf->st,lf->comp) > dp->budget){
+        break;
+      }
+      if( (r = workpool_submit(dp->wp,lex_file_task,lf)) ){
+        dp->nextlist = dp->count;
+        break;
+      }
+      dp->resident += list_charge(&lf->st,lf->comp);
+      ++dp->nextlist;
+    }
+  pthread_mutex_unlock(&dp->lock);
+  return r;
+}
+
+// A list charged size bytes is done with its mapping.
+static int
+release_list(struct dirparse *dp,size_t size){
+  pthread_mutex_lock(&dp->lock);
+    dp->resident -= size;
+  pthread_mutex_unlock(&dp->lock);
+  return submit_lists(dp);
+}
+
+// Called by the task which lexed the last chunk of a directory's list.
+static int
+finish_dirlist(struct pkgparse *pp){
+  struct dirparse *dp = pp->dp;
+  pkglist *pl = pp->sharedpcache;
+  size_t size = list_charge(&pl->st,pp->comp);
+  int r = pp->err,rr;
+
+  if(pp->fd >= 0){
+    close(pp->fd);
+  }
+  // A failed list is released with the cache if it was deduplicated, as
+  // other lists might still be using its pkgobjs. The cache is discarded.
+  // A refreshing cache instead unlinks the list's pkgobjs from their anchors
+  // before releasing it.
+  if(r && pp->dedup == NULL && !dp->keepfailed){
+    munmap((void *)pp->mem,pp->len);
+    free_package_list(pl);
+  }else{
+    if(pp->comp != COMP_NONE){ // we're done with compressed data
+      munmap((void *)pp->mem,pp->len);
+    }else{
+      adopt_map(pl,pp->mem,pp->len);
+    }
+    pl->stale = r != 0;
+    pthread_mutex_lock(&dp->lock);
+      pl->next = dp->sharedpcache->lists;
+      dp->sharedpcache->lists = pl;
+      dp->sharedpcache->byid[pl->listid] = pl;
+    pthread_mutex_unlock(&dp->lock);
+  }
+  free_pkgparse(pp);
+  free(pp);
+  if( (rr = release_list(dp,size)) && r == 0 ){
+    r = rr;
+  }
+  return r;
+}
+
+// Map the list, and split it into chunk tasks. We lex the first chunk
+// ourselves; the rest go onto our deque, to be stolen by idle workers. A
+// compressed list is instead decompressed as a stream of segment tasks.
+static int
+lex_file_task(workpool *wp,void *vlf){
+  struct listfile *lf = vlf;
+  struct dirparse *dp = lf->dp;
+  struct pkgparse *pp;
+  struct dfa **dfap;
+  const void *map;
+  int fd,err,r;
+  size_t mlen;
+  pkglist *pl;
+
+  dfap = dp->dfa ? &dp->dfa : NULL;
+  if((pp = malloc(sizeof(*pp))) == NULL){
+    err = errno;
+    release_list(dp,list_charge(&lf->st,lf->comp));
+    return err;
+  }
+  if(lf->buf){ // an anonymous mapping, released just like a file's
+    map = lf->buf;
+    mlen = lf->buflen;
+    fd = -1;
+    lf->buf = NULL;
+  }else if((map = mapit(dp->dirfd,lf->name,&mlen,&fd,list_io(dp),&err)) == MAP_FAILED){
+    free(pp);
+    release_list(dp,list_charge(&lf->st,lf->comp));
+    return err;
+  }
+  if( (r = init_pkgparse(pp,map,mlen,0,dfap,dp->threads,dp->flags,dp->ft,lf->comp,-1)) ){
+    munmap((void *)map,mlen);
+    if(fd >= 0){
+      close(fd);
+    }
+    free(pp);
+    release_list(dp,list_charge(&lf->st,lf->comp));
+    return r;
+  }
+  pp->dp = dp;
+  pp->fd = fd;
+  // Anonymous memory can't be discarded; it wouldn't be refaulted.
+  pp->discard = dp->budget && lf->comp == COMP_NONE && fd >= 0 &&
+                dp->io != RAPTORIAL_IO_PREAD && dp->io != RAPTORIAL_IO_URING;
+  pp->dedup = dp->dedup;
+  pl = pp->sharedpcache;
+  pl->listid = lf->listid;
+  pl->origwords = dp->dedup ? dp->dedup->words : 0;
+  pl->siblings = dp->sharedpcache->byid;
+  pl->uri = lf->meta.uri;
+  pl->distribution = lf->meta.dist;
+  pl->component = lf->meta.component;
+  pl->arch = lf->meta.arch;
+  memset(&lf->meta,0,sizeof(lf->meta));
+  pl->path = lf->name;
+  lf->name = NULL;
+  pl->st = lf->st;
+  if(lf->comp != COMP_NONE){
+    return stream_task(wp,pp);
+  }
+  submit_chunks(wp,pp,1);
+  return lex_chunk_task(wp,&pp->cparse[0]);
+}
+
+static int
+listfile_cmp(const void *va,const void *vb){
+  const struct listfile *a = va,*b = vb;
+
+  return a->st.st_size < b->st.st_size ? 1 :
+          a->st.st_size > b->st.st_size ? -1 : 0;
+}
+
+// The bytes we expect to lex from the lists.
+static size_t
+listfile_bytes(const struct listfile *lfs,unsigned count){
+  size_t bytes = 0;
+  unsigned z;
+
+  for(z = 0 ; z < count ; ++z){
+    bytes += list_charge(&lfs[z].st,lfs[z].comp);
+  }
+  return bytes;
+}
+
+static void
+free_listfiles(struct listfile *lfs,unsigned count){
+  while(count--){
+    free_listmeta(&lfs[count].meta);
+    free(lfs[count].name);
+    if(lfs[count].buf){
+      munmap(lfs[count].buf,lfs[count].buflen);
+    }
+  }
+  free(lfs);
+}
+
+// A directory's lists being read through io_uring by a single task, which
+// submits each list to be lexed as its read completes. That task occupies a
+// worker until every read has completed. A list which couldn't be read this
+// way is mapped by its lexing task, as usual.
+struct uringread {
+  uring ring;
+  workpool *wp;
+  struct listfile *lfs;
+  uringfile *ufs;
+  unsigned count;
+  int dirfd;
+};
+
+static int
+list_read(unsigned idx,int err,void *vur){
+  struct uringread *ur = vur;
+  struct listfile *lf = &ur->lfs[idx];
+  int r;
+
+  if(err == 0){
+    lf->buf = ur->ufs[idx].buf;
+    lf->buflen = ur->ufs[idx].len;
+  }
+  pthread_mutex_lock(&lf->dp->lock); // released when it's finished
+    lf->dp->resident += list_charge(&lf->st,lf->comp);
+  pthread_mutex_unlock(&lf->dp->lock);
+  if( (r = workpool_submit(ur->wp,lex_file_task,lf)) ){
+    if(lf->buf){
+      munmap(lf->buf,lf->buflen);
+      lf->buf = NULL;
+    }
+  }
+  return r;
 }
 
-PUBLIC const pkgobj *
-pkglist_begin(const pkglist *pl){
-  return pl->pobjs;
-}
+static int
+uring_read_task(workpool *wp,void *vur){
+  struct uringread *ur = vur;
 
-PUBLIC const pkgobj *
-pkglist_next(const pkgobj *po){
-  return po->next;
+  ur->wp = wp;
+  return uring_read_files(&ur->ring,ur->dirfd,ur->ufs,ur->count,list_read,ur);
 }
 
-PUBLIC const char *
-pkgobj_name(const pkgobj *po){
-  return po->name;
-}
+// Set up to read the lists through io_uring, if we can. Returns 0 if so.
+static int
+init_uringread(struct uringread *ur,int dirfd,struct listfile *lfs,
+               unsigned count){
+  unsigned z;
 
-PUBLIC const char *
-pkglist_dist(const pkglist *pl){
-  return pl->distribution;
+  if(count == 0){
+    return -1;
+  }
+  if((ur->ufs = malloc(sizeof(*ur->ufs) * count)) == NULL){
+    return -1;
+  }
+  if(uring_init(&ur->ring,count < 64 ? count : 64)){
+    free(ur->ufs);
+    return -1;
+  }
+  for(z = 0 ; z < count ; ++z){
+    ur->ufs[z].name = lfs[z].name;
+  }
+  ur->lfs = lfs;
+  ur->count = count;
+  ur->dirfd = dirfd;
+  return 0;
 }
 
-PUBLIC const char *
-pkgobj_version(const pkgobj *po){
-  return po->version;
+static int
+strvec_contains(const char * const *vec,const char *s){
+  while(*vec){
+    if(strcmp(*vec++,s) == 0){
+      return 1;
+    }
+  }
+  return 0;
 }
 
-PUBLIC unsigned
-pkgcache_count(const pkgcache *pc){
-  unsigned tot = 0;
+// Is the list live, wanted, and not shadowed by an uncompressed copy? If so,
+// lf's metadata is filled in, and it's stat()ed. Returns 1 if so, 0 if the
+// list ought be skipped, or -1 on error.
+static int
+admit_listfile(struct listfile *lf,int dirfd,const releaseset *rs,
+               const aptsources *as,const raptorial_lexopts *opts,int *err){
+  size_t complen,namelen;
+  struct stat st;
+  int r;
 
-  if(pc){
-    pkglist *pl;
+  comp_from_name(lf->name,&complen);
+  namelen = strlen(lf->name) - complen;
+  if((r = classify_list(lf->name,namelen,rs,as,&lf->meta,err)) <= 0){
+    return r;
+  }
+  if(opts && opts->archs && !strvec_contains(opts->archs,lf->meta.arch)){
+    return 0;
+  }
+  if(opts && opts->components &&
+      !strvec_contains(opts->components,lf->meta.component)){
+    return 0;
+  }
+  // If the uncompressed list is also present, use it instead.
+  if(lf->comp != COMP_NONE){
+    char uncomp[namelen + 1];
 
-    for(pl = pc->lists ; pl ; pl = pl ->next){
-      tot += pl->pcount;
+    memcpy(uncomp,lf->name,namelen);
+    uncomp[namelen] = '\0';
+    if(fstatat(dirfd,uncomp,&st,0) == 0){
+      return 0;
     }
   }
-  return tot;
+  if(fstatat(dirfd,lf->name,&lf->st,0)){
+    *err = errno;
+    return -1;
+  }
+  return 1;
 }
 
-static void *
-lex_dir(void *vdp){
-  struct dirparse *dp = vdp;
+// Collect the package lists of the directory, along with their sizes. Lists
+// are first gathered by name, along with any Release files, and then
+// admitted once the live index set is known. Skipped lists are never
+// opened.
+static int
+read_listdir(DIR *dir,const raptorial_lexopts *opts,struct listfile **plfs,
+             unsigned *count,int *err){
+  aptsources as = { .srcs = NULL, };
+  releaseset rs = { .rels = NULL, };
+  struct listfile *lfs = NULL;
   struct dirent *pdent;
-  struct dfa **dfap;
-       
-  dfap = dp->dfa ? &dp->dfa : NULL;
-  while(errno = 0, (pdent = readdir(dp->dir)) != NULL){
+  unsigned alloc = 0,z,kept;
+  int r;
+
+  *count = 0;
+  while(errno = 0, (pdent = readdir(dir)) != NULL){
     const char *suffixes[] = { "Sources", "Packages", NULL }, **suffix;
-    const char *distdelim, *dist, *uridelim;
-    pkglist *pl;
+    size_t namelen, complen;
+    struct listfile *lf;
+    compkind comp;
 
     if(pdent->d_type != DT_REG && pdent->d_type != DT_LNK){
       continue; // FIXME maybe don't skip DT_UNKNOWN?
     }
-    if((uridelim = strchr(pdent->d_name, '_')) == NULL){
-      continue;
-    }
-    if((dist = strstr(uridelim, "_dists_")) == NULL){
+    if(is_release_name(pdent->d_name)){
+      if( (r = add_release(&rs, dirfd(dir), pdent->d_name)) ){
+        *err = r;
+        goto err;
+      }
       continue;
     }
-    dist += strlen("_dists_");
-    if((distdelim = strchr(dist, '_')) == NULL){
+    // Lists might be compressed (Acquire::GzipIndexes etc.), in which case
+    // the list's suffix precedes the compression's.
+    if((comp = comp_from_name(pdent->d_name, &complen)) == COMP_UNSUPPORTED){
       continue;
     }
+    namelen = strlen(pdent->d_name) - complen;
     for(suffix = suffixes ; *suffix ; ++suffix){
-      if(strlen(pdent->d_name) < strlen(*suffix)){
+      if(namelen < strlen(*suffix)){
         continue;
       }
-      if(strcmp(pdent->d_name + strlen(pdent->d_name) - strlen(*suffix), *suffix) == 0){
-        int err;
-
-        if((pl = lex_packages_file_internal(pdent->d_name, &err, 0, dfap)) == NULL){
-          return NULL;
-        }
-        if((pl->distribution = strndup(dist, distdelim - dist)) == NULL){
-          free_package_list(pl);
-          return NULL;
-        }
-        if((pl->uri = strndup(pdent->d_name, uridelim - dist)) == NULL){
-          free_package_list(pl);
-          return NULL;
-        }
-        pthread_mutex_lock(&dp->lock);
-          pl->next = dp->sharedpcache->lists;
-          dp->sharedpcache->lists = pl;
-        pthread_mutex_unlock(&dp->lock);
+      if(strncmp(pdent->d_name + namelen - strlen(*suffix), *suffix, strlen(*suffix)) == 0){
         break;
       }
     }
+    if(*suffix == NULL){
+      continue;
+    }
+    if(*count == alloc){
+      unsigned nalloc = alloc ? alloc * 2 : 32;
+
+      if((lf = realloc(lfs, sizeof(*lfs) * nalloc)) == NULL){
+        *err = errno;
+        goto err;
+      }
+      lfs = lf;
+      alloc = nalloc;
+    }
+    lf = &lfs[*count];
+    memset(lf, 0, sizeof(*lf));
+    if((lf->name = strdup(pdent->d_name)) == NULL){
+      *err = errno;
+      goto err;
+    }
+    lf->comp = comp;
+    ++*count;
   }
   if(errno){
-    return NULL;
+    *err = errno;
+    goto err;
+  }
+  if(opts && opts->sources && (r = load_sources(&as, opts->sources))){
+    *err = r;
+    goto err;
+  }
+  // With no sources configured, we can't say what's stale.
+  for(z = 0, kept = 0 ; z < *count ; ++z){
+    if((r = admit_listfile(&lfs[z], dirfd(dir), &rs, as.count ? &as : NULL, opts, err)) < 0){
+      while(z < *count){ // move the rest down to be freed
+        lfs[kept++] = lfs[z++];
+      }
+      *count = kept;
+      goto err;
+    }
+    if(r){
+      lfs[kept++] = lfs[z];
+    }else{
+      free_listmeta(&lfs[z].meta);
+      free(lfs[z].name);
+    }
+  }
+  *count = kept;
+  free_aptsources(&as);
+  free_releaseset(&rs);
+  *plfs = lfs;
+  return 0;
+
+err:
+  free_aptsources(&as);
+  free_releaseset(&rs);
+  free_listfiles(lfs, *count);
+  return -1;
+}
+
+// Size the table from the bytes we expect to lex, assuming a stanza of at
+// least 256 bytes.
+static int
+init_deduptab(deduptab *dt,const struct listfile *lfs,unsigned count){
+  size_t bytes = listfile_bytes(lfs,count),buckets,z;
+
+  for(buckets = 256 ; buckets < bytes / 256 ; buckets *= 2){
+    ;
   }
-  return dp;
+  if((dt->buckets = malloc(sizeof(*dt->buckets) * buckets)) == NULL){
+    return errno;
+  }
+  for(z = 0 ; z < buckets ; ++z){
+    atomic_init(&dt->buckets[z],NULL);
+  }
+  dt->mask = buckets - 1;
+  dt->words = (count + 63) / 64;
+  return 0;
 }
 
-// len is the true length, less than or equal to the mapped length.
+// Lists are scheduled largest first, and split into chunks by whichever
+// worker picks them up. Workers which run out of lists steal chunks. The
+// lists take ids from firstid, and are entered into the cache's byid, which
+// must have room for them. The listfiles are freed.
 static int
-lex_listdir(pkgcache *pc,DIR *dir,int *err,struct dfa *dfa){
+lex_listfiles(pkgcache *pc,int dirfd,struct listfile *lfs,unsigned count,
+              unsigned firstid,struct dfa *dfa,const raptorial_lexopts *opts,
+              const fieldtab *ft,int keepfailed,int *err){
   struct dirparse dp = {
-    .dir = dir,
+    .dirfd = dirfd,
     .dfa = dfa,
+    .flags = lexopts_flags(opts),
+    .io = lexopts_io(opts),
+    .ft = ft,
+    .keepfailed = keepfailed,
     .sharedpcache = pc,
+    .threads = threads_for_bytes(lexopts_pool(opts),listfile_bytes(lfs,count)),
+    .lfs = lfs,
+    .count = count,
+    .budget = opts ? opts->membudget : 0,
   };
-  blossom_ctl bctl = {
-    .flags = 0,
-    .tids = 1,
-  };
-  blossom_state bs;
-  int r;
+  struct uringread ur;
+  int r,ret = 0,uringing;
+  deduptab dt;
+  workpool wp;
+  unsigned z;
 
+  qsort(lfs,count,sizeof(*lfs),listfile_cmp);
+  if(dp.flags & RAPTORIAL_LEX_DEDUP){
+    if( (r = init_deduptab(&dt,lfs,count)) ){
+      *err = r;
+      free_listfiles(lfs,count);
+      return -1;
+    }
+    dp.dedup = &dt;
+  }
   if( (r = pthread_mutex_init(&dp.lock,NULL)) ){
     *err = r;
+    if(dp.dedup){
+      free(dt.buckets);
+    }
+    free_listfiles(lfs,count);
     return -1;
   }
-  if(blossom_per_pe(&bctl,&bs,NULL,lex_dir,&dp)){
-    *err = errno;
+  if( (r = workpool_init(&wp,dp.threads,lexopts_pool(opts))) ){
+    *err = r;
     pthread_mutex_destroy(&dp.lock);
+    if(dp.dedup){
+      free(dt.buckets);
+    }
+    free_listfiles(lfs,count);
+    return -1;
+  }
+  for(z = 0 ; z < count ; ++z){
+    lfs[z].dp = &dp;
+    lfs[z].listid = firstid + z;
+  }
+  // io_uring reads every list up front, and so can't honor a budget.
+  uringing = dp.io == RAPTORIAL_IO_URING && dp.budget == 0 &&
+              init_uringread(&ur,dirfd,lfs,count) == 0;
+  dp.wp = &wp;
+  if(uringing){
+    dp.nextlist = count; // they're all submitted as they're read
+    if( (r = workpool_submit(&wp,uring_read_task,&ur)) ){
+      *err = r;
+      ret = -1;
+    }
+  }else if( (r = submit_lists(&dp)) ){
+    *err = r;
+    ret = -1;
+  }
+  // Lists already submitted must be run regardless, to release them.
+  if(workpool_run(&wp,err)){
+    ret = -1;
+  }
+  workpool_destroy(&wp);
+  if(uringing){
+    uring_free(&ur.ring);
+    free(ur.ufs);
+  }
+  pthread_mutex_destroy(&dp.lock);
+  if(dp.dedup){ // the pkgobjs' origins outlive the table
+    free(dt.buckets);
+  }
+  free_listfiles(lfs,count);
+  return ret;
+}
+
+static int
+lex_listdir(pkgcache *pc,DIR *dir,int *err,struct dfa *dfa,
+            const raptorial_lexopts *opts,const fieldtab *ft){
+  struct listfile *lfs;
+  unsigned count;
+
+  if(read_listdir(dir,opts,&lfs,&count,err)){
     return -1;
   }
-  if(blossom_join_all(&bs)){
+  if((pc->byid = calloc(count ? count : 1,sizeof(*pc->byid))) == NULL){
     *err = errno;
-    blossom_free_state(&bs);
-    pthread_mutex_destroy(&dp.lock);
+    free_listfiles(lfs,count);
     return -1;
   }
-  if(blossom_validate_joinrets(&bs)){
-    blossom_free_state(&bs);
-    pthread_mutex_destroy(&dp.lock);
+  pc->nlists = count;
+  return lex_listfiles(pc,dirfd(dir),lfs,count,0,dfa,opts,ft,0,err);
+}
+
+// Unlink the pkgobjs of stale lists from the anchor's chain.
+static int
+unlink_stale(const char *str __attribute__ ((unused)),const void *vanchor,
+             const void *opaque __attribute__ ((unused))){
+  pkgobj *prev = (pkgobj *)vanchor,*po;
+
+  while( (po = atomic_load_explicit(&prev->dfanext,memory_order_relaxed)) ){
+    if(po->pl->stale){
+      atomic_store_explicit(&prev->dfanext,
+                            atomic_load_explicit(&po->dfanext,memory_order_relaxed),
+                            memory_order_relaxed);
+    }else{
+      prev = po;
+    }
+  }
+  return 0;
+}
+
+// Push each of the list's packages matched by the dfa onto its anchor.
+static void
+attach_list(pkglist *pl,const struct dfa *dfa){
+  dfactx dctx;
+  pkgobj *po;
+
+  for(po = pl->pobjs ; po ; po = po->next){
+    pkgobj *mpo;
+
+    init_dfactx(&dctx,dfa);
+    if( (mpo = match_dfactx_nstring(&dctx,po->name,po->namelen)) ){
+      push_match(mpo,po);
+    }
+  }
+}
+
+// Push the indexed packages bearing the anchor's name onto it.
+static int
+attach_indexed(const char *name,const void *vanchor,const void *vpc){
+  const pkgcache *pc = vpc;
+  const pkgobj * const *pkgs;
+  size_t n;
+
+  n = pkgcache_lookup(pc,name,&pkgs);
+  while(n--){
+    push_match((pkgobj *)vanchor,(pkgobj *)pkgs[n]);
+  }
+  return 0;
+}
+
+// An indexed cache is joined from the dfa's side: each anchor's name is
+// looked up, which is far cheaper than matching every package.
+PUBLIC int
+pkgcache_attach(pkgcache *pc,struct dfa *dfa,int *err){
+  pkglist *pl;
+
+  if(pc->dfa || pc->table){
+    *err = EINVAL;
+    return -1;
+  }
+  if(pc->idx.slots){
+    walk_dfa(dfa,attach_indexed,pc);
+  }else{
+    for(pl = pc->lists ; pl ; pl = pl->next){
+      attach_list(pl,dfa);
+    }
+  }
+  pc->dfa = dfa;
+  pc->attached = 1;
+  return 0;
+}
+
+// Free the cache's stale lists, once nothing refers to their pkgobjs.
+// Returns the number freed.
+static unsigned
+drop_stale_lists(pkgcache *pc){
+  unsigned dropped = 0;
+  pkglist **prev,*pl;
+
+  for(pl = pc->lists ; pl ; pl = pl->next){
+    dropped += pl->stale;
+  }
+  if(dropped == 0){
+    return 0;
+  }
+  walk_dfa(pc->dfa,unlink_stale,NULL);
+  prev = &pc->lists;
+  while( (pl = *prev) ){
+    if(pl->stale){
+      *prev = pl->next;
+      free_package_list(pl);
+    }else{
+      prev = &pl->next;
+    }
+  }
+  return dropped;
+}
+
+// Renumber the cache's live lists densely, making room in byid for extra
+// more. This can only fail if byid must grow.
+static int
+renumber_lists(pkgcache *pc,unsigned extra){
+  unsigned count = 0,z;
+  pkglist **byid,*pl;
+
+  for(pl = pc->lists ; pl ; pl = pl->next){
+    count += !pl->stale;
+  }
+  byid = pc->byid;
+  if(count + extra > pc->nlists){
+    if((byid = realloc(byid,sizeof(*byid) * (count + extra))) == NULL){
+      return errno;
+    }
+    pc->byid = byid;
+  }
+  z = 0;
+  for(pl = pc->lists ; pl ; pl = pl->next){
+    if(!pl->stale){
+      pl->listid = z;
+      pl->siblings = byid;
+      byid[z++] = pl;
+    }
+  }
+  while(z < count + extra){
+    byid[z++] = NULL;
+  }
+  pc->nlists = count + extra;
+  return 0;
+}
+
+static inline int
+same_file(const struct stat *a,const struct stat *b){
+  return a->st_dev == b->st_dev && a->st_ino == b->st_ino &&
+          a->st_size == b->st_size &&
+          a->st_mtim.tv_sec == b->st_mtim.tv_sec &&
+          a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+// Mark lists whose files have changed or vanished as stale, and drop the
+// listfiles of those which haven't, returning how many remain.
+static unsigned
+diff_listfiles(pkgcache *pc,struct listfile *lfs,unsigned count){
+  unsigned z,kept = 0;
+  pkglist *pl;
+
+  for(pl = pc->lists ; pl ; pl = pl->next){
+    pl->stale = 1;
+  }
+  for(z = 0 ; z < count ; ++z){
+    for(pl = pc->lists ; pl ; pl = pl->next){
+      if(pl->stale && strcmp(pl->path,lfs[z].name) == 0){
+        break;
+      }
+    }
+    if(pl && same_file(&pl->st,&lfs[z].st)){
+      pl->stale = 0;
+      free_listmeta(&lfs[z].meta);
+      free(lfs[z].name);
+    }else{
+      lfs[kept++] = lfs[z];
+    }
+  }
+  return kept;
+}
+
+// New and changed lists are lexed into the cache as usual, except that one
+// which fails is kept until its pkgobjs have been unlinked from the anchors.
+PUBLIC int
+pkgcache_refresh(pkgcache *pc,const char *dir,int *err){
+  unsigned count,firstid,id;
+  struct listfile *lfs;
+  int r,ret = 0;
+  fieldtab ft;
+  pkglist *pl;
+  DIR *d;
+
+  if(pc->byid == NULL){
+    *err = EINVAL;
+    return -1;
+  }
+  if(pc->opts.flags & (RAPTORIAL_LEX_DEDUP | RAPTORIAL_LEX_COLUMNAR)){
+    *err = ENOTSUP;
+    return -1;
+  }
+  if((d = opendir(dir)) == NULL){
+    *err = errno;
     return -1;
   }
-  blossom_free_state(&bs);
-  if((r = pthread_mutex_destroy(&dp.lock))){
+  if(read_listdir(d,&pc->opts,&lfs,&count,err)){
+    closedir(d);
+    return -1;
+  }
+  count = diff_listfiles(pc,lfs,count);
+  if( (r = renumber_lists(pc,count)) || (r = init_fieldtab(&ft,pc->opts.fields)) ){
+    for(pl = pc->lists ; pl ; pl = pl->next){
+      pl->stale = 0;
+    }
+    renumber_lists(pc,0);
     *err = r;
+    free_listfiles(lfs,count);
+    closedir(d);
     return -1;
   }
-  return 0;
+  if(drop_stale_lists(pc) == 0 && count == 0){
+    free_fieldtab(&ft);
+    free(lfs);
+    closedir(d);
+    return 0;
+  }
+  firstid = pc->nlists - count;
+  if(lex_listfiles(pc,dirfd(d),lfs,count,firstid,
+                   pc->attached ? NULL : pc->dfa,&pc->opts,&ft,1,err)){
+    ret = -1;
+  }
+  free_fieldtab(&ft);
+  closedir(d);
+  if(pc->attached){ // new lists were lexed unfiltered, and must be attached
+    for(id = firstid ; id < pc->nlists ; ++id){
+      if(pc->byid[id] && !pc->byid[id]->stale){
+        attach_list(pc->byid[id],pc->dfa);
+      }
+    }
+  }
+  renumber_lists(pc,0); // pass over lists which failed, or were never made
+  drop_stale_lists(pc);
+  // The index refers to pkgobjs of dropped lists, and must be rebuilt.
+  if(pc->opts.flags & RAPTORIAL_LEX_INDEX){
+    nameindex_free(&pc->idx);
+    if( (r = index_pkgcache(pc)) && ret == 0 ){
+      *err = r;
+      ret = -1;
+    }
+  }
+  return ret;
 }
 
 PUBLIC pkgcache *
 lex_packages_dir(const char *dir,int *err,struct dfa *dfa){
+  return lex_packages_dir_opts(dir,err,dfa,NULL);
+}
+
+PUBLIC pkgcache *
+lex_packages_dir_opts(const char *dir,int *err,struct dfa *dfa,
+                      const raptorial_lexopts *opts){
   pkgcache *pc;
+  fieldtab ft;
   DIR *d;
+  int r;
 
+  if( (r = check_columnar(lexopts_flags(opts),lexopts_fields(opts),0)) ){
+    *err = r;
+    return NULL;
+  }
+  if(opts && opts->membudget &&
+      (opts->flags & (RAPTORIAL_LEX_ZEROCOPY | RAPTORIAL_LEX_FIELDS))){
+    *err = EINVAL;
+    return NULL;
+  }
+  if( (r = init_fieldtab(&ft,lexopts_fields(opts))) ){
+    *err = r;
+    return NULL;
+  }
   if((pc = create_pkgcache(NULL,err)) == NULL){
+    free_fieldtab(&ft);
     return NULL;
   }
   if((d = opendir(dir)) == NULL){
     *err = errno;
+    free_fieldtab(&ft);
     free_package_cache(pc);
     return NULL;
   }
-  // Change directory so that relative dent.d_name entries can be opened
-  if(chdir(dir)){
-    *err = errno;
-    closedir(d);
-    free_package_cache(pc);
-    return NULL;
+  pc->dfa = dfa;
+  if(opts){
+    pc->opts = *opts;
   }
-  if(lex_listdir(pc,d,err,dfa)){
+  r = lex_listdir(pc,d,err,dfa,opts,&ft);
+  free_fieldtab(&ft);
+  if(r){
     closedir(d);
     free_package_cache(pc);
     return NULL;
   }
+  if(lexopts_flags(opts) & (RAPTORIAL_LEX_INDEX | RAPTORIAL_LEX_COLUMNAR)){
+    if(lexopts_flags(opts) & RAPTORIAL_LEX_INDEX){
+      r = index_pkgcache(pc);
+    }else{
+      r = tabulate_pkgcache(pc);
+    }
+    if(r){
+      *err = r;
+      closedir(d);
+      free_package_cache(pc);
+      return NULL;
+    }
+  }
   if(closedir(d)){
     free_package_cache(pc);
     return NULL;
@@ -697,8 +2993,8 @@ pkgcache_find_installed(const pkgobj *mpo){
   if(mpo->version == NULL){
     return NULL;
   }
-  for(po = mpo->dfanext ; po ; po = po->dfanext){
-    if(po->version && debcmp(po->version,mpo->version) == 0){
+  for(po = next_match(mpo) ; po ; po = next_match(po)){
+    if(po->version && pkgobj_vercmp(po,mpo) == 0){
       return po;
     }
   }
@@ -709,8 +3005,8 @@ PUBLIC const struct pkgobj *
 pkgcache_find_newest(const pkgobj *mpo){
   const pkgobj *po,*newest = NULL;
 
-  for(po = mpo->dfanext ; po ; po = po->dfanext){
-    if(!newest || debcmp(newest->version,po->version) < 0){
+  for(po = next_match(mpo) ; po ; po = next_match(po)){
+    if(!newest || pkgobj_vercmp(newest,po) < 0){
       newest = po;
     }
   }
@@ -719,28 +3015,56 @@ pkgcache_find_newest(const pkgobj *mpo){
 
 struct pkgobj *create_stub_package(const char *name,int *err){
   pkgobj *po;
-  int r;
 
-  if((po = create_package(name,strlen(name),NULL,0,NULL)) == NULL){
+  if((po = create_package(NULL,name,strlen(name),NULL,0,NULL,0,NULL,0,0)) == NULL){
     *err = errno;
-  }else if( (r = pthread_mutex_init(&po->lock,NULL)) ){
-    *err = r;
-    free(po);
-    po = NULL;
-  }else{
-    po->haslock = 1;
   }
   return po;
 }
 
 const pkgobj *
 pkgobj_matchbegin(const pkgobj *mpo){
-  return mpo->dfanext;
+  return next_match(mpo);
 }
 
 const pkgobj *
 pkgobj_matchnext(const pkgobj *po){
-  return po->dfanext;
+  return next_match(po);
+}
+
+// The first of po's lists at or beyond listid.
+static const pkglist *
+origin_from(const pkgobj *po,unsigned listid){
+  const origins *o;
+  unsigned w;
+
+  if((o = pkgobj_origins(po)) == NULL){
+    return listid == 0 ? po->pl : NULL;
+  }
+  for(w = listid / 64 ; w < po->pl->origwords ; ++w){
+    uint64_t bits = atomic_load_explicit(&o->bits[w],memory_order_relaxed);
+
+    if(w == listid / 64){
+      bits &= ~0ull << (listid % 64);
+    }
+    if(bits){
+      return po->pl->siblings[w * 64 + __builtin_ctzll(bits)];
+    }
+  }
+  return NULL;
+}
+
+PUBLIC const pkglist *
+pkgobj_originbegin(const pkgobj *po){
+  return origin_from(po,0);
+}
+
+PUBLIC const pkglist *
+pkgobj_originnext(const pkgobj *po,const pkglist *pl){
+  if(pkgobj_origins(po) == NULL){
+    return NULL;
+  }
+  return origin_from(po,pl->listid + 1);
 }
 
 const char *
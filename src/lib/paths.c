@@ -4,6 +4,7 @@
 #define STATUSFILE_DEFAULT "/var/lib/dpkg/status"
 #define CONTENTDIR_DEFAULT "/var/cache/apt/apt-file"
 #define CHANGELOG_DEFAULT "debian/changelog"
+#define SOURCESLIST_DEFAULT "/etc/apt/sources.list"
 
 const char *raptorial_def_lists_dir(void){
 	return LISTDIR_DEFAULT;
@@ -20,3 +21,7 @@ const char *raptorial_def_content_dir(void){
 const char *raptorial_def_changelog(void){
 	return CHANGELOG_DEFAULT;
 }
+
+const char *raptorial_def_sources_list(void){
+	return SOURCESLIST_DEFAULT;
+}
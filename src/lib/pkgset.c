@@ -0,0 +1,402 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pkgset.h>
+#include <raptorial.h>
+
+enum {
+  OP_AND,
+  OP_OR,
+  OP_ANDNOT,
+};
+
+static inline size_t
+popcount_words(const uint64_t *w,size_t n){
+  size_t card = 0;
+
+  while(n--){
+    card += __builtin_popcountll(*w++);
+  }
+  return card;
+}
+
+static void
+free_container(container *c){
+  if(c->card <= ARRAY_MAX){
+    free(c->u.array);
+  }else{
+    free(c->u.bitmap);
+  }
+}
+
+// Fill c from a full bitmap of CONTAINER_WORDS words having card bits set,
+// which is adopted if c is to be dense (and otherwise left to the caller).
+static int
+container_from_words(container *c,uint64_t *words,size_t card,int adopt){
+  size_t w,z;
+
+  c->card = card;
+  if(card > ARRAY_MAX){
+    if(adopt){
+      c->u.bitmap = words;
+    }else if((c->u.bitmap = malloc(sizeof(*words) * CONTAINER_WORDS)) == NULL){
+      return errno;
+    }else{
+      memcpy(c->u.bitmap,words,sizeof(*words) * CONTAINER_WORDS);
+    }
+    return 0;
+  }
+  if((c->u.array = malloc(sizeof(*c->u.array) * (card ? card : 1))) == NULL){
+    int r = errno;
+
+    if(adopt){
+      free(words);
+    }
+    return r;
+  }
+  for(z = 0, w = 0 ; w < CONTAINER_WORDS ; ++w){
+    uint64_t bits = words[w];
+
+    while(bits){
+      c->u.array[z++] = w * 64 + __builtin_ctzll(bits);
+      bits &= bits - 1;
+    }
+  }
+  if(adopt){
+    free(words);
+  }
+  return 0;
+}
+
+// The container's members as a bitmap: its own, or expanded into tmp.
+static const uint64_t *
+container_words(const container *c,uint64_t *tmp){
+  uint32_t z;
+
+  if(c->card > ARRAY_MAX){
+    return c->u.bitmap;
+  }
+  memset(tmp,0,sizeof(*tmp) * CONTAINER_WORDS);
+  for(z = 0 ; z < c->card ; ++z){
+    tmp[c->u.array[z] / 64] |= 1ull << (c->u.array[z] % 64);
+  }
+  return tmp;
+}
+
+static int
+copy_container(container *dst,const container *src){
+  size_t len;
+
+  *dst = *src;
+  len = src->card > ARRAY_MAX ? sizeof(uint64_t) * CONTAINER_WORDS :
+                                sizeof(uint16_t) * src->card;
+  if((dst->u.array = malloc(len ? len : 1)) == NULL){
+    return errno;
+  }
+  memcpy(dst->u.array,src->u.array,len);
+  return 0;
+}
+
+// Merge two sorted arrays.
+static uint32_t
+merge_arrays(const container *a,const container *b,int op,uint16_t *out){
+  uint32_t i = 0,j = 0,n = 0;
+
+  while(i < a->card && j < b->card){
+    if(a->u.array[i] < b->u.array[j]){
+      if(op != OP_AND){
+        out[n++] = a->u.array[i];
+      }
+      ++i;
+    }else if(a->u.array[i] > b->u.array[j]){
+      if(op == OP_OR){
+        out[n++] = b->u.array[j];
+      }
+      ++j;
+    }else{
+      if(op != OP_ANDNOT){
+        out[n++] = a->u.array[i];
+      }
+      ++i;
+      ++j;
+    }
+  }
+  if(op != OP_AND){
+    while(i < a->card){
+      out[n++] = a->u.array[i++];
+    }
+  }
+  if(op == OP_OR){
+    while(j < b->card){
+      out[n++] = b->u.array[j++];
+    }
+  }
+  return n;
+}
+
+// Combine two containers sharing a key. out->card is 0 if the result is
+// empty, in which case nothing is allocated. Two arrays are merged; if
+// either is dense, both are treated as bitmaps, and combined a word at a
+// time (a loop the compiler can vectorize).
+static int
+combine_containers(const container *a,const container *b,int op,container *out){
+  uint64_t tmpa[CONTAINER_WORDS],tmpb[CONTAINER_WORDS];
+  const uint64_t *wa,*wb;
+  uint64_t *words;
+  size_t w;
+
+  out->key = a->key;
+  if(a->card <= ARRAY_MAX && b->card <= ARRAY_MAX){
+    uint16_t merged[ARRAY_MAX * 2];
+
+    out->card = merge_arrays(a,b,op,merged);
+    if(out->card == 0){
+      return 0;
+    }
+    if(out->card > ARRAY_MAX){
+      if((words = calloc(CONTAINER_WORDS,sizeof(*words))) == NULL){
+        return errno;
+      }
+      for(w = 0 ; w < out->card ; ++w){
+        words[merged[w] / 64] |= 1ull << (merged[w] % 64);
+      }
+      out->u.bitmap = words;
+      return 0;
+    }
+    if((out->u.array = malloc(sizeof(*merged) * out->card)) == NULL){
+      return errno;
+    }
+    memcpy(out->u.array,merged,sizeof(*merged) * out->card);
+    return 0;
+  }
+  wa = container_words(a,tmpa);
+  wb = container_words(b,tmpb);
+  if((words = malloc(sizeof(*words) * CONTAINER_WORDS)) == NULL){
+    return errno;
+  }
+  switch(op){
+  case OP_AND:
+    for(w = 0 ; w < CONTAINER_WORDS ; ++w){
+      words[w] = wa[w] & wb[w];
+    }
+    break;
+  case OP_OR:
+    for(w = 0 ; w < CONTAINER_WORDS ; ++w){
+      words[w] = wa[w] | wb[w];
+    }
+    break;
+  case OP_ANDNOT:
+    for(w = 0 ; w < CONTAINER_WORDS ; ++w){
+      words[w] = wa[w] & ~wb[w];
+    }
+    break;
+  }
+  if((out->card = popcount_words(words,CONTAINER_WORDS)) == 0){
+    free(words);
+    return 0;
+  }
+  return container_from_words(out,words,out->card,1);
+}
+
+static pkgset *
+create_pkgset(unsigned conts,int *err){
+  pkgset *ps;
+
+  if((ps = malloc(sizeof(*ps))) == NULL){
+    *err = errno;
+    return NULL;
+  }
+  if((ps->conts = malloc(sizeof(*ps->conts) * (conts ? conts : 1))) == NULL){
+    *err = errno;
+    free(ps);
+    return NULL;
+  }
+  ps->count = 0;
+  ps->card = 0;
+  return ps;
+}
+
+// Walk both sets' containers in key order, combining those sharing a key.
+static pkgset *
+pkgset_op(const pkgset *a,const pkgset *b,int op,int *err){
+  unsigned i = 0,j = 0;
+  pkgset *ps;
+  int r = 0;
+
+  if((ps = create_pkgset(a->count + b->count,err)) == NULL){
+    return NULL;
+  }
+  while(r == 0 && (i < a->count || j < b->count)){
+    container *out = &ps->conts[ps->count];
+
+    if(j == b->count || (i < a->count && a->conts[i].key < b->conts[j].key)){
+      if(op == OP_AND){
+        out->card = 0;
+      }else{
+        r = copy_container(out,&a->conts[i]);
+      }
+      ++i;
+    }else if(i == a->count || a->conts[i].key > b->conts[j].key){
+      if(op == OP_OR){
+        r = copy_container(out,&b->conts[j]);
+      }else{
+        out->card = 0;
+      }
+      ++j;
+    }else{
+      r = combine_containers(&a->conts[i],&b->conts[j],op,out);
+      ++i;
+      ++j;
+    }
+    if(r == 0 && out->card){
+      ps->card += out->card;
+      ++ps->count;
+    }
+  }
+  if(r){
+    *err = r;
+    pkgset_free(ps);
+    return NULL;
+  }
+  return ps;
+}
+
+pkgset *pkgset_from_bitmap(const uint64_t *bits,size_t nbits,int *err){
+  size_t words = (nbits + 63) / 64,base;
+  uint64_t tmp[CONTAINER_WORDS];
+  pkgset *ps;
+  int r;
+
+  if((ps = create_pkgset((words + CONTAINER_WORDS - 1) / CONTAINER_WORDS,err)) == NULL){
+    return NULL;
+  }
+  for(base = 0 ; base < words ; base += CONTAINER_WORDS){
+    size_t n = words - base < CONTAINER_WORDS ? words - base : CONTAINER_WORDS;
+    container *c = &ps->conts[ps->count];
+    size_t card;
+
+    if((card = popcount_words(bits + base,n)) == 0){
+      continue;
+    }
+    memcpy(tmp,bits + base,sizeof(*tmp) * n);
+    memset(tmp + n,0,sizeof(*tmp) * (CONTAINER_WORDS - n));
+    c->key = base / CONTAINER_WORDS;
+    if( (r = container_from_words(c,tmp,card,0)) ){
+      *err = r;
+      pkgset_free(ps);
+      return NULL;
+    }
+    ps->card += card;
+    ++ps->count;
+  }
+  return ps;
+}
+
+PUBLIC pkgset *
+pkgset_intersect(const pkgset *a,const pkgset *b,int *err){
+  return pkgset_op(a,b,OP_AND,err);
+}
+
+PUBLIC pkgset *
+pkgset_union(const pkgset *a,const pkgset *b,int *err){
+  return pkgset_op(a,b,OP_OR,err);
+}
+
+PUBLIC pkgset *
+pkgset_difference(const pkgset *a,const pkgset *b,int *err){
+  return pkgset_op(a,b,OP_ANDNOT,err);
+}
+
+PUBLIC size_t
+pkgset_count(const pkgset *ps){
+  return ps->card;
+}
+
+// The first container with a key of at least key.
+static unsigned
+find_container(const pkgset *ps,uint32_t key){
+  unsigned lo = 0,hi = ps->count;
+
+  while(lo < hi){
+    unsigned mid = lo + (hi - lo) / 2;
+
+    if(ps->conts[mid].key < key){
+      lo = mid + 1;
+    }else{
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// The first member of c which is at least low, or -1.
+static int32_t
+container_next(const container *c,uint32_t low){
+  if(c->card > ARRAY_MAX){
+    size_t w = low / 64;
+    uint64_t bits = c->u.bitmap[w] & (~0ull << (low % 64));
+
+    for(;;){
+      if(bits){
+        return w * 64 + __builtin_ctzll(bits);
+      }
+      if(++w == CONTAINER_WORDS){
+        return -1;
+      }
+      bits = c->u.bitmap[w];
+    }
+  }else{
+    uint32_t lo = 0,hi = c->card;
+
+    while(lo < hi){
+      uint32_t mid = lo + (hi - lo) / 2;
+
+      if(c->u.array[mid] < low){
+        lo = mid + 1;
+      }else{
+        hi = mid;
+      }
+    }
+    return lo < c->card ? c->u.array[lo] : -1;
+  }
+}
+
+PUBLIC int
+pkgset_contains(const pkgset *ps,unsigned id){
+  unsigned z = find_container(ps,id >> 16);
+
+  if(z == ps->count || ps->conts[z].key != id >> 16){
+    return 0;
+  }
+  return container_next(&ps->conts[z],id & 0xffffu) == (int32_t)(id & 0xffffu);
+}
+
+PUBLIC int
+pkgset_next(const pkgset *ps,unsigned *id){
+  unsigned z;
+
+  for(z = find_container(ps,*id >> 16) ; z < ps->count ; ++z){
+    const container *c = &ps->conts[z];
+    uint32_t low = c->key == *id >> 16 ? *id & 0xffffu : 0;
+    int32_t m;
+
+    if((m = container_next(c,low)) >= 0){
+      *id = (c->key << 16) | m;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+PUBLIC void
+pkgset_free(pkgset *ps){
+  if(ps){
+    unsigned z;
+
+    for(z = 0 ; z < ps->count ; ++z){
+      free_container(&ps->conts[z]);
+    }
+    free(ps->conts);
+    free(ps);
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef RAPTORIAL_PKGSET
+#define RAPTORIAL_PKGSET
+
+// private compressed bitmaps over name ids for raptorial
+#include <stddef.h>
+#include <stdint.h>
+
+// Ids are split by their high 16 bits into containers of up to 65536
+// members. A sparse container is a sorted array of its members' low 16 bits;
+// a dense one (more than ARRAY_MAX members) is a 65536-bit bitmap. Empty
+// containers are never kept.
+#define ARRAY_MAX 4096
+#define CONTAINER_WORDS (65536 / 64)
+
+typedef struct container {
+  uint32_t key;  // the high 16 bits of the members
+  uint32_t card; // members; the array's length if card <= ARRAY_MAX
+  union {
+    uint16_t *array;
+    uint64_t *bitmap;
+  } u;
+} container;
+
+typedef struct pkgset {
+  container *conts; // sorted by key
+  unsigned count;
+  size_t card;
+} pkgset;
+
+// Build a set from a dense bitmap of nbits bits. Returns NULL on error,
+// with the error written through.
+pkgset *pkgset_from_bitmap(const uint64_t *,size_t,int *);
+
+#endif
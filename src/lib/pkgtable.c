@@ -0,0 +1,151 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pkgtable.h>
+#include <raptorial.h>
+
+// The segment, its columns and its strings are a single allocation.
+tableseg *tableseg_create(unsigned rows,size_t strbytes){
+  tableseg *ts;
+
+  if((ts = malloc(sizeof(*ts) + sizeof(uint32_t) * 2 * rows + strbytes)) == NULL){
+    return NULL;
+  }
+  ts->next = NULL;
+  ts->rows = 0;
+  ts->alloc = rows;
+  ts->name = (uint32_t *)(ts + 1);
+  ts->version = ts->name + rows;
+  ts->strings = (char *)(ts->version + rows);
+  ts->strbytes = 0;
+  ts->strsize = strbytes;
+  return ts;
+}
+
+static uint32_t
+tableseg_string(tableseg *ts,const char *s,size_t len){
+  uint32_t off = ts->strbytes;
+
+  memcpy(ts->strings + off,s,len);
+  ts->strings[off + len] = '\0';
+  ts->strbytes += len + 1;
+  return off;
+}
+
+void tableseg_add(tableseg *ts,const char *name,size_t namelen,
+                  const char *ver,size_t verlen){
+  ts->name[ts->rows] = tableseg_string(ts,name,namelen);
+  ts->version[ts->rows] = ver ? tableseg_string(ts,ver,verlen) : NOVERSION;
+  ++ts->rows;
+}
+
+void tableseg_free(tableseg *ts){
+  free(ts);
+}
+
+pkgtable *pkgtable_create(const struct pkglist **lists,tableseg **segs,
+                          unsigned nlists,int *err){
+  size_t rows = 0,strbytes = 0;
+  const tableseg *ts;
+  unsigned l,r,row;
+  pkgtable *pt;
+
+  for(l = 0 ; l < nlists ; ++l){
+    for(ts = segs[l] ; ts ; ts = ts->next){
+      rows += ts->rows;
+      strbytes += ts->strbytes;
+    }
+  }
+  if(rows >= UINT32_MAX || strbytes >= UINT32_MAX){
+    *err = EOVERFLOW;
+    return NULL;
+  }
+  if((pt = malloc(sizeof(*pt))) == NULL){
+    *err = errno;
+    return NULL;
+  }
+  memset(pt,0,sizeof(*pt));
+  pt->name = malloc(sizeof(*pt->name) * (rows ? rows : 1));
+  pt->version = malloc(sizeof(*pt->version) * (rows ? rows : 1));
+  pt->list = malloc(sizeof(*pt->list) * (rows ? rows : 1));
+  pt->strings = malloc(strbytes ? strbytes : 1);
+  pt->lists = malloc(sizeof(*pt->lists) * (nlists ? nlists : 1));
+  if(!pt->name || !pt->version || !pt->list || !pt->strings || !pt->lists){
+    *err = errno;
+    pkgtable_free(pt);
+    return NULL;
+  }
+  memcpy(pt->lists,lists,sizeof(*lists) * nlists);
+  pt->nlists = nlists;
+  row = 0;
+  for(l = 0 ; l < nlists ; ++l){
+    tableseg *next;
+
+    for(ts = segs[l] ; ts ; ts = next){
+      uint32_t base = pt->strbytes;
+
+      for(r = 0 ; r < ts->rows ; ++r, ++row){
+        pt->name[row] = base + ts->name[r];
+        pt->version[row] = ts->version[r] == NOVERSION ?
+                            NOVERSION : base + ts->version[r];
+        pt->list[row] = l;
+      }
+      memcpy(pt->strings + base,ts->strings,ts->strbytes);
+      pt->strbytes += ts->strbytes;
+      next = ts->next;
+      tableseg_free((tableseg *)ts);
+    }
+    segs[l] = NULL;
+  }
+  pt->rows = row;
+  return pt;
+}
+
+void pkgtable_free(pkgtable *pt){
+  if(pt){
+    free(pt->name);
+    free(pt->version);
+    free(pt->list);
+    free(pt->strings);
+    free(pt->lists);
+    free(pt);
+  }
+}
+
+PUBLIC unsigned
+pkgtable_rows(const pkgtable *pt){
+  return pt->rows;
+}
+
+PUBLIC const char *
+pkgtable_name(const pkgtable *pt,unsigned row){
+  return pt->strings + pt->name[row];
+}
+
+PUBLIC const char *
+pkgtable_version(const pkgtable *pt,unsigned row){
+  if(pt->version[row] == NOVERSION){
+    return NULL;
+  }
+  return pt->strings + pt->version[row];
+}
+
+PUBLIC unsigned
+pkgtable_listid(const pkgtable *pt,unsigned row){
+  return pt->list[row];
+}
+
+PUBLIC unsigned
+pkgtable_nlists(const pkgtable *pt){
+  return pt->nlists;
+}
+
+PUBLIC const struct pkglist *
+pkgtable_list(const pkgtable *pt,unsigned listid){
+  return pt->lists[listid];
+}
+
+PUBLIC const unsigned *
+pkgtable_listids(const pkgtable *pt){
+  return pt->list;
+}
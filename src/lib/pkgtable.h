@@ -0,0 +1,50 @@
+#ifndef RAPTORIAL_PKGTABLE
+#define RAPTORIAL_PKGTABLE
+
+// private columnar package storage for raptorial
+#include <stddef.h>
+#include <stdint.h>
+
+struct pkglist;
+
+// The rows lexed from one chunk of a list, in columns. Offsets are relative
+// to the segment's own string pool.
+typedef struct tableseg {
+  struct tableseg *next;
+  unsigned rows,alloc;
+  uint32_t *name,*version;
+  char *strings;
+  size_t strbytes,strsize;
+} tableseg;
+
+// rows and strbytes are exact; tableseg_add() must be called rows times.
+tableseg *tableseg_create(unsigned rows,size_t strbytes);
+
+// A NULL version is recorded as such.
+void tableseg_add(tableseg *,const char *,size_t,const char *,size_t);
+
+void tableseg_free(tableseg *);
+
+// The packages of a cache as dense columns, with 32-bit offsets into a
+// single string pool (names and versions being NUL-terminated therein) and
+// list ids, rather than pointer-chased pkgobjs.
+typedef struct pkgtable {
+  unsigned rows;
+  uint32_t *name,*version; // version is NOVERSION if absent
+  unsigned *list;          // indexes lists
+  char *strings;
+  size_t strbytes;
+  const struct pkglist **lists;
+  unsigned nlists;
+} pkgtable;
+
+#define NOVERSION UINT32_MAX
+
+// Concatenate the segments of each of the nlists lists. The segments are
+// consumed (and freed) on success; segs is otherwise untouched. Returns NULL
+// on error, with the error written through.
+pkgtable *pkgtable_create(const struct pkglist **,tableseg **,unsigned,int *);
+
+void pkgtable_free(pkgtable *);
+
+#endif
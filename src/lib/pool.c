@@ -0,0 +1,237 @@
+#include <pool.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <util.h>
+
+// Workers record the pool they're serving and their deque, so that tasks
+// they submit land on their own deque.
+static __thread workpool *curpool;
+static __thread unsigned curdeque;
+
+static void
+free_deques(workpool *wp){
+  unsigned z;
+
+  for(z = 0 ; z < wp->workers ; ++z){
+    pthread_mutex_destroy(&wp->deques[z].lock);
+    free(wp->deques[z].tasks);
+  }
+  free(wp->deques);
+  wp->deques = NULL;
+  wp->workers = 0;
+}
+
+int workpool_init(workpool *wp,unsigned workers,struct raptorial_pool *rpool){
+  unsigned z;
+  int r;
+
+  memset(wp,0,sizeof(*wp));
+  if(workers == 0){
+    workers = 1;
+  }
+  if((wp->deques = malloc(sizeof(*wp->deques) * workers)) == NULL){
+    return errno;
+  }
+  for(z = 0 ; z < workers ; ++z){
+    memset(&wp->deques[z],0,sizeof(wp->deques[z]));
+    if( (r = pthread_mutex_init(&wp->deques[z].lock,NULL)) ){
+      while(z--){
+        pthread_mutex_destroy(&wp->deques[z].lock);
+      }
+      free(wp->deques);
+      return r;
+    }
+  }
+  wp->workers = workers;
+  wp->rpool = rpool;
+  if( (r = pthread_mutex_init(&wp->lock,NULL)) ){
+    free_deques(wp);
+    return r;
+  }
+  if( (r = pthread_cond_init(&wp->cond,NULL)) ){
+    pthread_mutex_destroy(&wp->lock);
+    free_deques(wp);
+    return r;
+  }
+  return 0;
+}
+
+void workpool_destroy(workpool *wp){
+  pthread_cond_destroy(&wp->cond);
+  pthread_mutex_destroy(&wp->lock);
+  free_deques(wp);
+}
+
+static int
+deque_push_back(workdeque *wd,worktaskfxn fxn,void *arg){
+  pthread_mutex_lock(&wd->lock);
+  if(wd->count == wd->alloc){
+    unsigned nalloc = wd->alloc ? wd->alloc * 2 : 16,z;
+    worktask *tmp;
+
+    if((tmp = malloc(sizeof(*tmp) * nalloc)) == NULL){
+      pthread_mutex_unlock(&wd->lock);
+      return errno;
+    }
+    for(z = 0 ; z < wd->count ; ++z){
+      tmp[z] = wd->tasks[(wd->head + z) % wd->alloc];
+    }
+    free(wd->tasks);
+    wd->tasks = tmp;
+    wd->head = 0;
+    wd->alloc = nalloc;
+  }
+  wd->tasks[(wd->head + wd->count) % wd->alloc].fxn = fxn;
+  wd->tasks[(wd->head + wd->count) % wd->alloc].arg = arg;
+  ++wd->count;
+  pthread_mutex_unlock(&wd->lock);
+  return 0;
+}
+
+static int
+deque_pop_back(workdeque *wd,worktask *wt){
+  int ret = 0;
+
+  pthread_mutex_lock(&wd->lock);
+  if(wd->count){
+    *wt = wd->tasks[(wd->head + --wd->count) % wd->alloc];
+    ret = 1;
+  }
+  pthread_mutex_unlock(&wd->lock);
+  return ret;
+}
+
+static int
+deque_pop_front(workdeque *wd,worktask *wt){
+  int ret = 0;
+
+  pthread_mutex_lock(&wd->lock);
+  if(wd->count){
+    *wt = wd->tasks[wd->head];
+    wd->head = (wd->head + 1) % wd->alloc;
+    --wd->count;
+    ret = 1;
+  }
+  pthread_mutex_unlock(&wd->lock);
+  return ret;
+}
+
+int workpool_submit(workpool *wp,worktaskfxn fxn,void *arg){
+  unsigned d;
+  int r;
+
+  // Account for the task before it becomes visible, so that it can't be
+  // completed (decrementing outstanding) before it was counted.
+  pthread_mutex_lock(&wp->lock);
+  if(curpool == wp){
+    d = curdeque;
+  }else{
+    d = wp->nextdeque++ % wp->workers;
+  }
+  ++wp->outstanding;
+  if( (r = deque_push_back(&wp->deques[d],fxn,arg)) ){
+    --wp->outstanding;
+  }else{
+    ++wp->queued;
+  }
+  pthread_mutex_unlock(&wp->lock);
+  if(r == 0){
+    pthread_cond_signal(&wp->cond);
+  }
+  return r;
+}
+
+unsigned workpool_id(void){
+  return curpool ? curdeque : 0;
+}
+
+// A hold is counted as an outstanding task which never sits in a deque.
+void workpool_hold(workpool *wp){
+  pthread_mutex_lock(&wp->lock);
+  ++wp->outstanding;
+  pthread_mutex_unlock(&wp->lock);
+}
+
+void workpool_release(workpool *wp){
+  pthread_mutex_lock(&wp->lock);
+  if(--wp->outstanding == 0){
+    pthread_cond_broadcast(&wp->cond);
+  }
+  pthread_mutex_unlock(&wp->lock);
+}
+
+// Look first to our own deque, then steal from our peers, starting with our
+// neighbor so that thieves spread out.
+static int
+workpool_take(workpool *wp,unsigned id,worktask *wt){
+  unsigned z;
+
+  if(deque_pop_back(&wp->deques[id],wt)){
+    return 1;
+  }
+  for(z = 1 ; z < wp->workers ; ++z){
+    if(deque_pop_front(&wp->deques[(id + z) % wp->workers],wt)){
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void *
+workpool_worker(void *vwp){
+  unsigned id,prevdeque;
+  workpool *wp = vwp;
+  workpool *prevpool;
+  worktask wt;
+  int r;
+
+  // We might be running on a thread which is itself another pool's worker.
+  prevpool = curpool;
+  prevdeque = curdeque;
+  pthread_mutex_lock(&wp->lock);
+  id = wp->nextworker++ % wp->workers;
+  pthread_mutex_unlock(&wp->lock);
+  curpool = wp;
+  curdeque = id;
+  for(;;){
+    if(workpool_take(wp,id,&wt)){
+      pthread_mutex_lock(&wp->lock);
+      --wp->queued;
+      pthread_mutex_unlock(&wp->lock);
+      r = wt.fxn(wp,wt.arg);
+      pthread_mutex_lock(&wp->lock);
+      if(r && !wp->err){
+        wp->err = r;
+      }
+      if(--wp->outstanding == 0){
+        pthread_cond_broadcast(&wp->cond);
+      }
+      pthread_mutex_unlock(&wp->lock);
+      continue;
+    }
+    pthread_mutex_lock(&wp->lock);
+    while(wp->queued == 0 && wp->outstanding){
+      pthread_cond_wait(&wp->cond,&wp->lock);
+    }
+    if(wp->outstanding == 0){
+      pthread_mutex_unlock(&wp->lock);
+      break;
+    }
+    pthread_mutex_unlock(&wp->lock);
+  }
+  curpool = prevpool;
+  curdeque = prevdeque;
+  return wp;
+}
+
+int workpool_run(workpool *wp,int *err){
+  if(run_threads(wp->rpool,wp->workers,workpool_worker,wp,err)){
+    return -1;
+  }
+  if(wp->err){
+    *err = wp->err;
+    return -1;
+  }
+  return 0;
+}
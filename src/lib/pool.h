@@ -0,0 +1,73 @@
+#ifndef RAPTORIAL_POOL
+#define RAPTORIAL_POOL
+
+// private work-stealing scheduler for raptorial
+#include <pthread.h>
+
+struct workpool;
+struct raptorial_pool;
+
+// A task returns 0 on success, or an errno value on failure. Failure of any
+// task fails the run, but does not prevent the remaining tasks from running
+// (they might own resources which need be released).
+typedef int (*worktaskfxn)(struct workpool *,void *);
+
+typedef struct worktask {
+  worktaskfxn fxn;
+  void *arg;
+} worktask;
+
+// Each worker owns a deque, implemented as a ring buffer. A worker pushes the
+// tasks it submits onto the back of its own deque, and pops from the back
+// (the most recently split work is hottest in cache). Idle workers steal from
+// the front of their peers' deques, where the oldest -- and, since we submit
+// the largest work first, generally the biggest -- tasks live.
+typedef struct workdeque {
+  worktask *tasks;
+  unsigned head,count,alloc;
+  pthread_mutex_t lock;
+} workdeque;
+
+typedef struct workpool {
+  unsigned workers;
+  workdeque *deques;
+  struct raptorial_pool *rpool; // runs the workers, if non-NULL
+
+  // The lock protects everything below, and is used with cond to put idle
+  // workers to sleep. queued counts tasks sitting in deques; outstanding
+  // counts tasks which have been submitted but not yet completed. Once
+  // outstanding hits 0, the run is complete.
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  unsigned queued,outstanding;
+  unsigned nextworker; // assigns worker ids
+  unsigned nextdeque;  // round-robins submissions from outside the pool
+  int err;             // first task failure, if any
+} workpool;
+
+// The workers run on the raptorial_pool's threads if it's non-NULL.
+int workpool_init(workpool *,unsigned,struct raptorial_pool *);
+
+// Submit a task. From within a worker, the task goes onto that worker's
+// deque; otherwise, deques are filled round-robin, so submit largest first.
+int workpool_submit(workpool *,worktaskfxn,void *);
+
+// A thread outside the pool which will submit tasks during the run takes a
+// hold beforehand, so that the workers don't exit while awaiting its work,
+// and releases it once it has submitted its last task.
+void workpool_hold(workpool *);
+void workpool_release(workpool *);
+
+// The id of the calling worker, less than the pool's workers, or 0 if we're
+// not a worker.
+unsigned workpool_id(void);
+
+// Run the pool's workers until every task, including those submitted while
+// running, has completed. Without a raptorial_pool, a pool of one worker runs
+// on the calling thread. Returns 0 on success, or -1 with the first error
+// written through.
+int workpool_run(workpool *,int *);
+
+void workpool_destroy(workpool *);
+
+#endif
@@ -34,7 +34,140 @@ struct dfactx;
 struct pkgobj;
 struct pkglist;
 struct pkgcache;
+struct pkgtable;
+struct pkgset;
+struct pkgsnap;
 struct changelog;
+struct raptorial_pool;
+
+// Flags for raptorial_lexopts.flags.
+//
+// Don't copy package names and versions out of the list. They are instead
+// views into the list's mapping, which is retained until the list is freed.
+// Views are not NUL-terminated: use pkgobj_nameview() and
+// pkgobj_versionview(), as pkgobj_name() and pkgobj_version() return NULL.
+#define RAPTORIAL_LEX_ZEROCOPY 0x0001u
+
+// Retain the list's mapping, so that pkgobj_field() can be used. Implied by
+// RAPTORIAL_LEX_ZEROCOPY.
+#define RAPTORIAL_LEX_FIELDS   0x0002u
+
+// Index the cache's packages by name once they've been lexed, for use with
+// pkgcache_lookup(), pkgcache_prefix() and pkgcache_range(). When lexing a
+// single list, the index is built by pkgcache_from_pkglist().
+#define RAPTORIAL_LEX_INDEX    0x0004u
+
+// Store the cache's packages as a pkgtable (see pkgcache_table()) rather than
+// as pkgobjs, which are not made available: pkglist_begin() returns NULL for
+// such lists. When lexing a single list, the table is built by
+// pkgcache_from_pkglist(). Cannot be combined with other flags or fields,
+// nor used to build a dfa (EINVAL), though a dfa may filter the lists.
+#define RAPTORIAL_LEX_COLUMNAR 0x0008u
+
+// Collapse identical (name, version) pairs across a directory's lists into a
+// single pkgobj, which records every list it was found in: enumerate them with
+// pkgobj_originbegin() and pkgobj_originnext(). The pkgobj belongs to (and
+// reports the URI and distribution of) one of those lists, chosen
+// arbitrarily, and only that list's iteration will return it. Its stanza and
+// captured fields are likewise that list's. Only meaningful to
+// lex_packages_dir_opts().
+#define RAPTORIAL_LEX_DEDUP    0x0010u
+
+// How lists are brought into memory. Which is fastest depends on the host,
+// its filesystems, and whether the lists are likely to be cached.
+typedef enum {
+	// mmap() with MAP_POPULATE: the list is resident before lexing starts.
+	RAPTORIAL_IO_POPULATE,
+	// mmap() advised MADV_SEQUENTIAL and MADV_WILLNEED, so that lexing starts
+	// at once, overlapping the kernel's asynchronous readahead.
+	RAPTORIAL_IO_LAZY,
+	// mmap() advised MADV_HUGEPAGE before being populated, for transparent
+	// huge pages where the filesystem's page cache supports them (tmpfs).
+	RAPTORIAL_IO_HUGEPAGE,
+	// pread() into anonymous memory, for filesystems which can't be mapped,
+	// or on which page faults are expensive.
+	RAPTORIAL_IO_PREAD,
+	// As RAPTORIAL_IO_PREAD, except that a directory's lists are read through
+	// io_uring: the opens, statx()s and reads of every list are submitted up
+	// front, and each list is lexed as its read completes. This keeps a cold
+	// cache's disk busy. Lists are read synchronously where io_uring is
+	// unavailable (older kernels, or seccomp).
+	RAPTORIAL_IO_URING,
+} raptorial_io;
+
+// Options for raptorial_pool_create(). A NULL raptorial_poolopts is
+// equivalent to one which is zeroed out.
+typedef struct raptorial_poolopts {
+	// Threads to create, or 0 for one per CPU the pool may run on (or, if
+	// unpinned, per processing element).
+	unsigned threads;
+	// CPUs (as numbered by the kernel), and NUMA nodes whose CPUs are added
+	// to them, to which the pool's threads are pinned. Either may be NULL
+	// with a count of 0; if both are, the threads run wherever the process
+	// may. A node which doesn't exist is an error (ENOENT).
+	const unsigned *cpus;
+	unsigned cpucount;
+	const unsigned *nodes;
+	unsigned nodecount;
+} raptorial_poolopts;
+
+// A raptorial_pool is a set of threads, created once and lexed upon by any
+// number of calls (concurrent or otherwise) through raptorial_lexopts.pool,
+// rather than each call launching threads of its own. A call uses no more of
+// the pool's threads than there are processing elements, and lexing doesn't
+// run on the calling thread, which only waits. Returns NULL on error, writing
+// the error through.
+PUBLIC struct raptorial_pool *
+raptorial_pool_create(const raptorial_poolopts *,int *);
+
+// Stop the pool's threads and free it. No call may be using it.
+PUBLIC void
+raptorial_pool_free(struct raptorial_pool *);
+
+// Options for the lex_*_opts() family. A NULL raptorial_lexopts is equivalent
+// to one which is zeroed out.
+typedef struct raptorial_lexopts {
+	unsigned flags; // bitfield over RAPTORIAL_LEX_*
+	// NULL-terminated list of fields (e.g. "Architecture", "Multi-Arch") to
+	// capture while lexing, without their colons. Only the first instance of
+	// each field within a stanza is captured. These are recognized alongside
+	// Package and Version in a single pass, and are available through
+	// pkgobj_captured() (by index into this list) or pkgobj_field(). May be
+	// NULL. Requesting a field twice is an error (EINVAL).
+	const char * const *fields;
+	// Path of an apt sources.list (e.g. raptorial_def_sources_list()), to
+	// be read along with the *.list and *.sources files of its ".d"
+	// directory. When lexing a directory, lists not named by any of their
+	// deb and deb-src entries are stale, and skipped. If no entries are
+	// found, no lists are skipped. May be NULL. Independently, a list whose
+	// distribution has a Release or InRelease file in the directory is
+	// skipped unless that file names it.
+	const char *sources;
+	// NULL-terminated lists of architectures (e.g. "amd64", or "source" for
+	// Sources lists) and components (e.g. "main", or "updates/main") to be
+	// lexed from a directory. Other lists are skipped without being opened.
+	// Either may be NULL, admitting all.
+	const char * const *archs;
+	const char * const *components;
+	raptorial_io io; // RAPTORIAL_IO_POPULATE if zeroed
+	// When lexing a directory, an upper bound on the bytes of lists held in
+	// memory at once, or 0 for no bound. Lists are admitted largest first as
+	// those before them finish, and a list larger than the budget is lexed
+	// alone. The pages of mapped lists are released as their chunks are
+	// lexed, so that little more than the packages extracted from them stays
+	// resident. A compressed list counts against the budget at its estimated
+	// decompressed size. Under a budget, lists are never read through
+	// io_uring, and RAPTORIAL_IO_POPULATE and RAPTORIAL_IO_HUGEPAGE map them
+	// lazily.
+	// Incompatible with RAPTORIAL_LEX_ZEROCOPY and RAPTORIAL_LEX_FIELDS,
+	// which retain every list (EINVAL).
+	size_t membudget;
+	// Lex on the pool's threads, rather than launching threads for this
+	// call. May be NULL. A cache keeps indexing on the pool its lists were
+	// lexed on (in pkgcache_from_pkglist(), pkgcache_add_list() and
+	// pkgcache_refresh()), so the pool must outlive such use.
+	struct raptorial_pool *pool;
+} raptorial_lexopts;
 
 // Returns a new package list object after lexing the specified package list.
 // On error, NULL is returned, and the error value will be written through; it
@@ -46,6 +179,62 @@ struct changelog;
 PUBLIC struct pkglist *
 lex_packages_file(const char *,int *,struct dfa **);
 
+PUBLIC struct pkglist *
+lex_packages_file_opts(const char *,int *,struct dfa **,
+                       const raptorial_lexopts *);
+
+// As lex_packages_file(), but reading an uncompressed list from the fd (a
+// pipe, socket, or anything else which can't be mapped) through to its end.
+// The fd is neither rewound nor closed. A reader fills a bounded ring of
+// segments, carrying each partial stanza into the next, while the workers lex
+// them. The reader is a thread of its own, unless the call was given a
+// raptorial_pool, in which case the pool's workers take turns reading.
+PUBLIC struct pkglist *
+lex_packages_fd(int,int *,struct dfa **);
+
+PUBLIC struct pkglist *
+lex_packages_fd_opts(int,int *,struct dfa **,const raptorial_lexopts *);
+
+// A view into a list, valid only for the duration of a callback, and not
+// NUL-terminated. val is NULL if the field was absent.
+typedef struct raptorial_field {
+	const char *val;
+	size_t len;
+} raptorial_field;
+
+typedef struct raptorial_stanza {
+	raptorial_field package;
+	raptorial_field version;
+	raptorial_field text; // the whole stanza, through its final newline
+	const raptorial_field *fields; // the requested fields, in order
+	unsigned worker; // the calling thread, less than raptorial_workers()
+} raptorial_stanza;
+
+// Returns 0 to continue, or an error value to stop lexing.
+typedef int (*raptorial_stanzacb)(const raptorial_stanza *,void *);
+
+// Lex the specified package list without building a pkglist: the callback is
+// handed each stanza, with views of the NULL-terminated list of fields (which
+// may be NULL), straight out of the list's mapping (or, for a compressed
+// list, its decompressed segments). Nothing is allocated per stanza. Chunks
+// are lexed in parallel, so callbacks run concurrently and in no particular
+// order; state indexed by the stanza's worker needs no locking. Returns 0 on
+// success, or -1 with the error (perhaps the callback's) written through. A
+// callback's failure stops its chunk, but others might still be underway.
+PUBLIC int
+lex_packages_file_cb(const char *,const char * const *,raptorial_stanzacb,
+                     void *,int *);
+
+// As lex_packages_file_cb(), taking the fields, I/O strategy and pool from the
+// options. Their flags are ignored.
+PUBLIC int
+lex_packages_file_cb_opts(const char *,const raptorial_lexopts *,
+                          raptorial_stanzacb,void *,int *);
+
+// The most threads lexing will use, and thus the bound on a stanza's worker.
+PUBLIC unsigned
+raptorial_workers(void);
+
 // Returns a new package cache object after lexing any package lists found in
 // the specified directory. The lists will be processed in parallel.
 //
@@ -54,6 +243,10 @@ lex_packages_file(const char *,int *,struct dfa **);
 PUBLIC struct pkgcache *
 lex_packages_dir(const char *,int *,struct dfa *);
 
+PUBLIC struct pkgcache *
+lex_packages_dir_opts(const char *,int *,struct dfa *,
+                      const raptorial_lexopts *);
+
 // Walks all contents cachefiles. The tables will be processed in parallel.
 // Set the nocase flag for insensitive matching; in this case, the DFA must
 // have been built using lowercased patterns.
@@ -63,12 +256,90 @@ lex_packages_dir(const char *,int *,struct dfa *);
 PUBLIC int
 lex_contents_dir(const char *,int *,struct dfa *,int nocase);
 
+// As lex_contents_dir(), taking the pool from the options. Their other
+// members are ignored.
+PUBLIC int
+lex_contents_dir_opts(const char *,int *,struct dfa *,int nocase,
+                      const raptorial_lexopts *);
+
 // Wrap a package list in a single-index cache object. Returns NULL if passed
 // NULL, without modifying err, allowing use in functional composition. Frees
 // the pkglist on its own internal error, returning NULL and setting err.
 PUBLIC struct pkgcache *
 pkgcache_from_pkglist(struct pkglist *,int *);
 
+// Attach the packages of a cache lexed without a dfa to the dfa's anchors,
+// just as lexing filtered by the dfa would have (though unmatched packages
+// remain in the cache). This allows the lists to be lexed while the dfa is
+// still being built, say from the status file. Cheapest if the cache was
+// lexed with RAPTORIAL_LEX_INDEX. The dfa must outlive the cache's matches.
+// A cache can be attached only once, and not if it's columnar (EINVAL).
+// pkgcache_refresh() attaches the lists it lexes to the same dfa. Returns 0
+// on success, or -1 with the error written through.
+PUBLIC int
+pkgcache_attach(struct pkgcache *,struct dfa *,int *);
+
+// Bring a cache lexed by lex_packages_dir_opts() up to date with the
+// directory, as after "apt update". Lists whose files have changed (by
+// device, inode, size or modification time) or vanished are dropped, and new
+// or changed lists are lexed. Unchanged lists keep their pkgobjs and their
+// matches on the dfa's anchors, and the name index (if any) is rebuilt. The
+// dfa, and the fields, sources, archs, components and pool of the
+// raptorial_lexopts, that the cache was lexed with are used again, and must
+// still be valid. pkgobjs of dropped lists are freed, and nothing may use the
+// cache during the refresh. Unsupported for RAPTORIAL_LEX_DEDUP and
+// RAPTORIAL_LEX_COLUMNAR caches (ENOTSUP) and those not lexed from a
+// directory (EINVAL). Returns 0 on success. On error, -1 is returned and the
+// error written through; the cache remains usable, but might lack lists
+// which changed.
+PUBLIC int
+pkgcache_refresh(struct pkgcache *,const char *,int *);
+
+// A pkgsnap publishes successive generations of a pkgcache to concurrent
+// readers. A reader pins the current generation, which remains valid (and
+// unchanged) until it's unpinned, however many generations are published
+// meanwhile. Pinning and unpinning never block on a writer. A replaced
+// generation is freed once no reader might hold it.
+//
+// A published cache belongs to the pkgsnap, and mustn't be modified, nor
+// lexed with a dfa (matches are attached to the dfa's anchors, which are
+// shared by every generation).
+//
+// Create a pkgsnap with the initial generation (which may be NULL) and room
+// for the specified number of concurrent readers (0 for twice the number of
+// processing elements). Returns NULL on error, writing the error through.
+PUBLIC struct pkgsnap *
+pkgsnap_create(struct pkgcache *,unsigned,int *);
+
+// Pin the current generation, writing through a token for pkgsnap_unpin().
+// Waits only if more readers than were provided for are already pinned.
+PUBLIC const struct pkgcache *
+pkgsnap_pin(struct pkgsnap *,unsigned *);
+
+PUBLIC void
+pkgsnap_unpin(struct pkgsnap *,unsigned);
+
+// Make the cache the current generation. The previous generation is freed
+// now if no reader holds it, and otherwise by a later pkgsnap_publish() or
+// pkgsnap_reclaim(). Returns 0 on success; on error, -1 is returned, the
+// error written through, and the cache is not taken.
+PUBLIC int
+pkgsnap_publish(struct pkgsnap *,struct pkgcache *,int *);
+
+// Lex the directory with the options (without a dfa) into a new generation,
+// and publish it. Readers carry on with the previous generation meanwhile.
+PUBLIC int
+pkgsnap_refresh(struct pkgsnap *,const char *,const raptorial_lexopts *,int *);
+
+// Free whichever replaced generations no reader holds, returning how many
+// remain.
+PUBLIC unsigned
+pkgsnap_reclaim(struct pkgsnap *);
+
+// Free the pkgsnap and every generation. No reader may be pinned.
+PUBLIC void
+pkgsnap_free(struct pkgsnap *);
+
 PUBLIC void free_package_list(struct pkglist *);
 
 // Free the pkgcache and any associated state, including pkglists therein.
@@ -83,6 +354,17 @@ PUBLIC void free_package_cache(struct pkgcache *);
 PUBLIC struct pkglist *
 lex_status_file(const char *,int *,struct dfa **);
 
+PUBLIC struct pkglist *
+lex_status_file_opts(const char *,int *,struct dfa **,
+                     const raptorial_lexopts *);
+
+// As lex_status_file(), but reading from the fd, as lex_packages_fd().
+PUBLIC struct pkglist *
+lex_status_fd(int,int *,struct dfa **);
+
+PUBLIC struct pkglist *
+lex_status_fd_opts(int,int *,struct dfa **,const raptorial_lexopts *);
+
 PUBLIC const struct pkglist *
 pkgcache_begin(const struct pkgcache *);
 
@@ -110,12 +392,177 @@ pkglist_uri(const struct pkglist *);
 PUBLIC const char *
 pkglist_dist(const struct pkglist *);
 
+// The architecture ("source" for a Sources list) and component of a list
+// lexed from a directory. NULL for a list lexed on its own.
+PUBLIC const char *
+pkglist_arch(const struct pkglist *);
+
+PUBLIC const char *
+pkglist_component(const struct pkglist *);
+
 PUBLIC const char *
 pkgobj_version(const struct pkgobj *);
 
+// Length-aware views of the package's name and version, valid for the life of
+// the package's list, and available whether or not RAPTORIAL_LEX_ZEROCOPY was
+// used. The length is written through. The view is not NUL-terminated. A
+// stub package has no version, and returns NULL from pkgobj_versionview().
+PUBLIC const char *
+pkgobj_nameview(const struct pkgobj *,size_t *);
+
+PUBLIC const char *
+pkgobj_versionview(const struct pkgobj *,size_t *);
+
+// Look up an arbitrary field (e.g. "Depends") of the package's stanza. The
+// tag is matched case-insensitively, without its colon. Fields captured while
+// lexing are returned directly; others are parsed on demand. On success, a
+// view of the value is returned, and its length written through; multiline
+// values include their continuation lines verbatim. Returns NULL if the field
+// is absent, or if it wasn't captured and the package's list was lexed
+// without RAPTORIAL_LEX_FIELDS or RAPTORIAL_LEX_ZEROCOPY.
+PUBLIC const char *
+pkgobj_field(const struct pkgobj *,const char *,size_t *);
+
+// Return the field captured at the specified index of raptorial_lexopts'
+// fields, as a view with its length written through, or NULL if the stanza
+// lacked it. Copies are NUL-terminated unless RAPTORIAL_LEX_ZEROCOPY was used.
+PUBLIC const char *
+pkgobj_captured(const struct pkgobj *,unsigned,size_t *);
+
 PUBLIC unsigned
 pkgcache_count(const struct pkgcache *);
 
+// Name lookups against a cache lexed with RAPTORIAL_LEX_INDEX. Each returns
+// the number of matching packages, and writes through a view of them, valid
+// for the life of the cache. The view is sorted by name (bytewise); packages
+// sharing a name (from different lists) are in no particular order. Nothing
+// matches in a cache which wasn't indexed.
+//
+// pkgcache_lookup() matches the name exactly, using a hash table.
+PUBLIC size_t
+pkgcache_lookup(const struct pkgcache *,const char *,
+                const struct pkgobj * const **);
+
+// Matches every name beginning with the prefix.
+PUBLIC size_t
+pkgcache_prefix(const struct pkgcache *,const char *,
+                const struct pkgobj * const **);
+
+// Matches names within [lo, hi). A NULL hi extends through the last name.
+PUBLIC size_t
+pkgcache_range(const struct pkgcache *,const char *,const char *,
+               const struct pkgobj * const **);
+
+// The packages of a cache lexed with RAPTORIAL_LEX_COLUMNAR, or NULL if it
+// wasn't. Each row is a package; its name, version and list are held in
+// dense columns, and are best visited by a sequential scan over rows. Valid
+// for the life of the cache.
+PUBLIC const struct pkgtable *
+pkgcache_table(const struct pkgcache *);
+
+PUBLIC unsigned
+pkgtable_rows(const struct pkgtable *);
+
+// NUL-terminated. The version is NULL if the package had none.
+PUBLIC const char *
+pkgtable_name(const struct pkgtable *,unsigned);
+
+PUBLIC const char *
+pkgtable_version(const struct pkgtable *,unsigned);
+
+// Lists are identified by dense ids, in the order of pkgcache_begin() and
+// pkgcache_next(). pkgtable_listids() returns the column of every row's list
+// id, for scans which needn't visit the strings.
+PUBLIC unsigned
+pkgtable_listid(const struct pkgtable *,unsigned);
+
+PUBLIC const unsigned *
+pkgtable_listids(const struct pkgtable *);
+
+PUBLIC unsigned
+pkgtable_nlists(const struct pkgtable *);
+
+PUBLIC const struct pkglist *
+pkgtable_list(const struct pkgtable *,unsigned);
+
+// Name ids. Indexing a cache (RAPTORIAL_LEX_INDEX) numbers its distinct
+// package names densely, from 0 through pkgcache_names() - 1, in sorted
+// (bytewise) order. Ids are only meaningful within their cache, and are
+// renumbered should a list be added to it.
+#define RAPTORIAL_NONAMEID (~0u)
+
+PUBLIC unsigned
+pkgcache_names(const struct pkgcache *);
+
+// RAPTORIAL_NONAMEID if the cache wasn't indexed.
+PUBLIC unsigned
+pkgobj_nameid(const struct pkgobj *);
+
+// RAPTORIAL_NONAMEID if no package has the name.
+PUBLIC unsigned
+pkgcache_nameid(const struct pkgcache *,const char *);
+
+// A view of the name (not necessarily NUL-terminated), valid for the life of
+// the cache. NULL if the id isn't less than pkgcache_names() (as none is, if
+// the cache wasn't indexed).
+PUBLIC const char *
+pkgcache_idname(const struct pkgcache *,unsigned,size_t *);
+
+// Add a list (a status file's, for instance) to the cache, which takes
+// ownership of it. An indexed cache is reindexed, renumbering its names. On
+// failure, -1 is returned and the error written through; the list has been
+// added regardless, but the cache might no longer be indexed. Columnar caches
+// cannot be added to (EINVAL).
+PUBLIC int
+pkgcache_add_list(struct pkgcache *,struct pkglist *,int *);
+
+// Package sets are compressed bitmaps over an indexed cache's name ids, and
+// are built from a cache (EINVAL if it wasn't indexed). They remain valid
+// until it's freed or added to, but are not otherwise tied to it, and must
+// be released with pkgset_free(). Functions returning a set return NULL on
+// error, writing the error through.
+//
+// The names of a list's packages (including, in a deduplicated cache, those
+// held by other lists). The list must belong to the cache (EINVAL otherwise);
+// packages not numbered by its index (say, added since) are left out.
+PUBLIC struct pkgset *
+pkgset_from_list(const struct pkgcache *,const struct pkglist *,int *);
+
+// The names matched by the dfa.
+PUBLIC struct pkgset *
+pkgset_from_dfa(const struct pkgcache *,const struct dfa *,int *);
+
+// The names of packages satisfying the predicate, which is called once for
+// each of the cache's packages.
+PUBLIC struct pkgset *
+pkgset_from_pkgobjs(const struct pkgcache *,
+                    int (*)(const struct pkgobj *,void *),void *,int *);
+
+PUBLIC struct pkgset *
+pkgset_intersect(const struct pkgset *,const struct pkgset *,int *);
+
+PUBLIC struct pkgset *
+pkgset_union(const struct pkgset *,const struct pkgset *,int *);
+
+// Members of the first set which aren't members of the second.
+PUBLIC struct pkgset *
+pkgset_difference(const struct pkgset *,const struct pkgset *,int *);
+
+PUBLIC size_t
+pkgset_count(const struct pkgset *);
+
+PUBLIC int
+pkgset_contains(const struct pkgset *,unsigned);
+
+// Find the least member not less than *id, writing it through, and return
+// non-zero; return 0 if there is no such member. Iterate with:
+//  for(id = 0 ; pkgset_next(ps,&id) ; ++id)
+PUBLIC int
+pkgset_next(const struct pkgset *,unsigned *);
+
+PUBLIC void
+pkgset_free(struct pkgset *);
+
 PUBLIC const char *
 raptorial_def_lists_dir(void);
 
@@ -128,6 +575,9 @@ raptorial_def_content_dir(void);
 PUBLIC const char *
 raptorial_def_changelog(void);
 
+PUBLIC const char *
+raptorial_def_sources_list(void);
+
 typedef struct dfactx {
 	const struct dfa *dfa;
 	unsigned cur;
@@ -159,6 +609,14 @@ pkgobj_matchbegin(const struct pkgobj *);
 PUBLIC const struct pkgobj *
 pkgobj_matchnext(const struct pkgobj *);
 
+// Iterate over the lists in which the package was found. Unless it was lexed
+// with RAPTORIAL_LEX_DEDUP, this is only the package's own list.
+PUBLIC const struct pkglist *
+pkgobj_originbegin(const struct pkgobj *);
+
+PUBLIC const struct pkglist *
+pkgobj_originnext(const struct pkgobj *,const struct pkglist *);
+
 PUBLIC const char *
 pkgobj_uri(const struct pkgobj *);
 
@@ -0,0 +1,57 @@
+#include <scan.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+static uint64_t
+newline_mask64_scalar(const char *p){
+  uint64_t mask = 0;
+  unsigned z;
+
+  for(z = 0 ; z < 64 ; ++z){
+    mask |= (uint64_t)(p[z] == '\n') << z;
+  }
+  return mask;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__ ((target ("sse2"))) static uint64_t
+newline_mask64_sse2(const char *p){
+  const __m128i nl = _mm_set1_epi8('\n');
+  uint64_t mask = 0;
+  unsigned z;
+
+  for(z = 0 ; z < 4 ; ++z){
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + z * 16));
+    uint64_t m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v,nl));
+
+    mask |= m << (z * 16);
+  }
+  return mask;
+}
+
+__attribute__ ((target ("avx2"))) static uint64_t
+newline_mask64_avx2(const char *p){
+  const __m256i nl = _mm256_set1_epi8('\n');
+  __m256i lo = _mm256_loadu_si256((const __m256i *)p);
+  __m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+  uint64_t mlo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo,nl));
+  uint64_t mhi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi,nl));
+
+  return mlo | (mhi << 32);
+}
+#endif
+
+uint64_t (*newline_mask64)(const char *) = newline_mask64_scalar;
+
+__attribute__ ((constructor)) static void
+scan_init(void){
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")){
+    newline_mask64 = newline_mask64_avx2;
+  }else if(__builtin_cpu_supports("sse2")){
+    newline_mask64 = newline_mask64_sse2;
+  }
+#endif
+}
@@ -0,0 +1,63 @@
+#ifndef RAPTORIAL_SCAN
+#define RAPTORIAL_SCAN
+
+// private vectorized line scanning for raptorial
+#include <stdint.h>
+#include <stddef.h>
+
+// Returns a bitmask of the newlines among the 64 bytes at p: bit n is set iff
+// p[n] == '\n'. All 64 bytes must be readable. This is bound at load time to
+// the widest implementation the CPU supports (AVX2, SSE2, or scalar).
+extern uint64_t (*newline_mask64)(const char *);
+
+// Walks the newlines of [s, end) in order, 64 bytes at a time. Rather than
+// test every byte of a line, the lexer asks for the next newline, and only
+// looks at the line starts.
+typedef struct linescan {
+  const char *block; // base of the current 64-byte block
+  const char *end;
+  uint64_t mask;     // newlines of block not yet returned
+} linescan;
+
+static inline uint64_t
+newline_mask(const char *p,const char *end){
+  uint64_t mask = 0;
+  unsigned z;
+
+  if(end - p >= 64){
+    return newline_mask64(p);
+  }
+  for(z = 0 ; p + z < end ; ++z){
+    if(p[z] == '\n'){
+      mask |= 1ull << z;
+    }
+  }
+  return mask;
+}
+
+static inline void
+linescan_init(linescan *ls,const char *s,const char *end){
+  ls->block = s;
+  ls->end = end;
+  ls->mask = s < end ? newline_mask(s,end) : 0;
+}
+
+// Returns the next newline, or end if there are no more.
+static inline const char *
+linescan_next(linescan *ls){
+  unsigned bit;
+
+  while(ls->mask == 0){
+    if(ls->end - ls->block <= 64){
+      ls->block = ls->end;
+      return ls->end;
+    }
+    ls->block += 64;
+    ls->mask = newline_mask(ls->block,ls->end);
+  }
+  bit = __builtin_ctzll(ls->mask);
+  ls->mask &= ls->mask - 1;
+  return ls->block + bit;
+}
+
+#endif
@@ -0,0 +1,183 @@
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <util.h>
+#include <raptorial.h>
+
+// A replaced generation, to be freed once no reader can still hold it.
+typedef struct retired {
+  struct retired *next;
+  struct pkgcache *pc;
+  uint64_t epoch; // readers pinned before this epoch might hold pc
+} retired;
+
+// Epoch-based reclamation. A reader claims a slot, announcing the epoch in
+// which it pinned (a free slot holds 0), and only then loads the current
+// generation. A writer swaps in the new generation, then advances the epoch,
+// retiring the old generation with the new epoch. A reader whose slot holds
+// an earlier epoch might have loaded the old generation; any other loaded
+// the new one. Retired generations are freed once every slot is free or
+// holds at least their epoch.
+typedef struct pkgsnap {
+  _Atomic(struct pkgcache *) cur;
+  _Atomic uint64_t epoch; // starts at 1
+  _Atomic uint64_t *slots;
+  unsigned nslots;
+  pthread_mutex_t lock; // serializes writers, and protects retired
+  retired *retired;
+} pkgsnap;
+
+PUBLIC pkgsnap *
+pkgsnap_create(struct pkgcache *pc,unsigned readers,int *err){
+  pkgsnap *ps;
+  unsigned z;
+  int r;
+
+  if(readers == 0){
+    readers = online_pes() * 2;
+  }
+  if((ps = malloc(sizeof(*ps))) == NULL){
+    *err = errno;
+    return NULL;
+  }
+  if((ps->slots = malloc(sizeof(*ps->slots) * readers)) == NULL){
+    *err = errno;
+    free(ps);
+    return NULL;
+  }
+  if( (r = pthread_mutex_init(&ps->lock,NULL)) ){
+    *err = r;
+    free(ps->slots);
+    free(ps);
+    return NULL;
+  }
+  for(z = 0 ; z < readers ; ++z){
+    atomic_init(&ps->slots[z],0);
+  }
+  ps->nslots = readers;
+  atomic_init(&ps->cur,pc);
+  atomic_init(&ps->epoch,1);
+  ps->retired = NULL;
+  return ps;
+}
+
+// Readers start their search for a free slot at a point derived from their
+// stack, so concurrent readers on different threads tend not to collide.
+PUBLIC const struct pkgcache *
+pkgsnap_pin(pkgsnap *ps,unsigned *pin){
+  unsigned start = ((uintptr_t)&start >> 12) % ps->nslots,z;
+
+  for(;;){
+    for(z = 0 ; z < ps->nslots ; ++z){
+      unsigned s = (start + z) % ps->nslots;
+      uint64_t idle = 0;
+
+      if(atomic_load_explicit(&ps->slots[s],memory_order_relaxed)){
+        continue;
+      }
+      if(atomic_compare_exchange_strong(&ps->slots[s],&idle,
+                                        atomic_load(&ps->epoch))){
+        *pin = s;
+        return atomic_load(&ps->cur);
+      }
+    }
+    sched_yield(); // every slot is taken; wait for a reader to finish
+  }
+}
+
+PUBLIC void
+pkgsnap_unpin(pkgsnap *ps,unsigned pin){
+  atomic_store(&ps->slots[pin],0);
+}
+
+// Free whichever retired generations no reader can hold, returning how many
+// remain. Called with the lock held.
+static unsigned
+reclaim(pkgsnap *ps){
+  uint64_t oldest = UINT64_MAX;
+  retired **prev,*r;
+  unsigned z,left = 0;
+
+  for(z = 0 ; z < ps->nslots ; ++z){
+    uint64_t e = atomic_load(&ps->slots[z]);
+
+    if(e && e < oldest){
+      oldest = e;
+    }
+  }
+  prev = &ps->retired;
+  while( (r = *prev) ){
+    if(r->epoch <= oldest){
+      *prev = r->next;
+      free_package_cache(r->pc);
+      free(r);
+    }else{
+      prev = &r->next;
+      ++left;
+    }
+  }
+  return left;
+}
+
+PUBLIC int
+pkgsnap_publish(pkgsnap *ps,struct pkgcache *pc,int *err){
+  retired *r;
+
+  if((r = malloc(sizeof(*r))) == NULL){
+    *err = errno;
+    return -1;
+  }
+  pthread_mutex_lock(&ps->lock);
+    r->pc = atomic_exchange(&ps->cur,pc);
+    r->epoch = atomic_fetch_add(&ps->epoch,1) + 1;
+    r->next = ps->retired;
+    ps->retired = r;
+    reclaim(ps);
+  pthread_mutex_unlock(&ps->lock);
+  return 0;
+}
+
+PUBLIC unsigned
+pkgsnap_reclaim(pkgsnap *ps){
+  unsigned left;
+
+  pthread_mutex_lock(&ps->lock);
+    left = reclaim(ps);
+  pthread_mutex_unlock(&ps->lock);
+  return left;
+}
+
+PUBLIC int
+pkgsnap_refresh(pkgsnap *ps,const char *dir,const raptorial_lexopts *opts,
+                int *err){
+  struct pkgcache *pc;
+
+  if((pc = lex_packages_dir_opts(dir,err,NULL,opts)) == NULL){
+    return -1;
+  }
+  if(pkgsnap_publish(ps,pc,err)){
+    free_package_cache(pc);
+    return -1;
+  }
+  return 0;
+}
+
+PUBLIC void
+pkgsnap_free(pkgsnap *ps){
+  if(ps){
+    retired *r;
+
+    while( (r = ps->retired) ){
+      ps->retired = r->next;
+      free_package_cache(r->pc);
+      free(r);
+    }
+    free_package_cache(atomic_load(&ps->cur));
+    pthread_mutex_destroy(&ps->lock);
+    free(ps->slots);
+    free(ps);
+  }
+}
@@ -0,0 +1,810 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <decomp.h>
+#include <sources.h>
+
+static int
+strv_add(strv *sv,const char *s,size_t len){
+  char *dup;
+
+  if(sv->count == sv->alloc){
+    unsigned nalloc = sv->alloc ? sv->alloc * 2 : 8;
+    char **tmp;
+
+    if((tmp = realloc(sv->v,sizeof(*tmp) * nalloc)) == NULL){
+      return errno;
+    }
+    sv->v = tmp;
+    sv->alloc = nalloc;
+  }
+  if((dup = strndup(s,len)) == NULL){
+    return errno;
+  }
+  sv->v[sv->count++] = dup;
+  return 0;
+}
+
+static void
+strv_free(strv *sv){
+  while(sv->count){
+    free(sv->v[--sv->count]);
+  }
+  free(sv->v);
+  sv->v = NULL;
+  sv->alloc = 0;
+}
+
+int strv_contains(const strv *sv,const char *s){
+  unsigned z;
+
+  for(z = 0 ; z < sv->count ; ++z){
+    if(strcmp(sv->v[z],s) == 0){
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int
+strv_cmp(const void *va,const void *vb){
+  return strcmp(*(char * const *)va,*(char * const *)vb);
+}
+
+// Sort the vector for strv_search(), dropping duplicates.
+static void
+strv_sort(strv *sv){
+  unsigned r,w;
+
+  if(sv->count == 0){
+    return;
+  }
+  qsort(sv->v,sv->count,sizeof(*sv->v),strv_cmp);
+  for(r = 1, w = 1 ; r < sv->count ; ++r){
+    if(strcmp(sv->v[r],sv->v[w - 1])){
+      sv->v[w++] = sv->v[r];
+    }else{
+      free(sv->v[r]);
+    }
+  }
+  sv->count = w;
+}
+
+static int
+strv_search(const strv *sv,const char *s){
+  return bsearch(&s,sv->v,sv->count,sizeof(*sv->v),strv_cmp) != NULL;
+}
+
+// Add each of the whitespace- or comma-separated values of s.
+static int
+strv_split(strv *sv,const char *s,size_t len){
+  const char *end = s + len;
+  int r = 0;
+
+  while(r == 0 && s < end){
+    size_t vlen = 0;
+
+    while(s < end && (isspace((unsigned char)*s) || *s == ',')){
+      ++s;
+    }
+    while(s + vlen < end && !isspace((unsigned char)s[vlen]) && s[vlen] != ','){
+      ++vlen;
+    }
+    if(vlen){
+      r = strv_add(sv,s,vlen);
+    }
+    s += vlen;
+  }
+  return r;
+}
+
+// The next whitespace-delimited token of *s, advancing *s past it.
+static const char *
+next_token(const char **s,size_t *len){
+  const char *t = *s;
+
+  while(isspace((unsigned char)*t)){
+    ++t;
+  }
+  if(*t == '\0'){
+    *s = t;
+    return NULL;
+  }
+  for(*len = 0 ; t[*len] && !isspace((unsigned char)t[*len]) ; ++*len){
+    ;
+  }
+  *s = t + *len;
+  return t;
+}
+
+// Strip trailing whitespace (including the newline), returning the length.
+static size_t
+chomp(char *line,size_t len){
+  while(len && isspace((unsigned char)line[len - 1])){
+    line[--len] = '\0';
+  }
+  return len;
+}
+
+int is_release_name(const char *name){
+  const char *base,*dists;
+
+  if((base = strrchr(name,'_')) == NULL){
+    return 0;
+  }
+  if(strcmp(base,"_Release") && strcmp(base,"_InRelease")){
+    return 0;
+  }
+  if((dists = strstr(name,"_dists_")) == NULL){
+    return 0;
+  }
+  return base > dists + strlen("_dists_");
+}
+
+static int
+is_hash_field(const char *line){
+  const char *hashes[] = { "MD5Sum:", "SHA1:", "SHA256:", "SHA512:", NULL, },
+        **h;
+
+  for(h = hashes ; *h ; ++h){
+    if(strcasecmp(line,*h) == 0){
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Collect the paths of the checksum fields' entries (" hash size path"). An
+// InRelease file's signature armor is skipped.
+static int
+parse_release(FILE *fp,strv *paths){
+  int armored = 0,inheader = 0,inhash = 0,first = 1,r = 0;
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+
+  while(r == 0 && (len = getline(&line,&cap,fp)) >= 0){
+    len = chomp(line,len);
+    if(first){
+      first = 0;
+      if(strcmp(line,"-----BEGIN PGP SIGNED MESSAGE-----") == 0){
+        armored = inheader = 1;
+        continue;
+      }
+    }
+    if(inheader){ // armor headers run through the first blank line
+      inheader = len != 0;
+      continue;
+    }
+    if(armored && strncmp(line,"-----BEGIN PGP SIGNATURE",24) == 0){
+      break;
+    }
+    if(line[0] == ' ' || line[0] == '\t'){
+      const char *s = line,*tok,*path = NULL;
+      size_t toklen,pathlen = 0,sufflen;
+
+      if(!inhash){
+        continue;
+      }
+      while( (tok = next_token(&s,&toklen)) ){
+        path = tok;
+        pathlen = toklen;
+      }
+      if(path){ // the last token, and thus NUL-terminated
+        comp_from_name(path,&sufflen);
+        r = strv_add(paths,path,pathlen - sufflen);
+      }
+    }else{
+      inhash = is_hash_field(line);
+    }
+  }
+  if(r == 0 && ferror(fp)){
+    r = errno ? errno : EIO;
+  }
+  free(line);
+  return r;
+}
+
+int add_release(releaseset *rs,int dirfd,const char *name){
+  size_t prefixlen = strrchr(name,'_') - name;
+  release *rel;
+  unsigned z;
+  FILE *fp;
+  int fd,r;
+
+  for(z = 0 ; z < rs->count ; ++z){
+    if(rs->rels[z].prefixlen == prefixlen &&
+        strncmp(rs->rels[z].prefix,name,prefixlen) == 0){
+      return 0;
+    }
+  }
+  if(rs->count == rs->alloc){
+    unsigned nalloc = rs->alloc ? rs->alloc * 2 : 8;
+
+    if((rel = realloc(rs->rels,sizeof(*rel) * nalloc)) == NULL){
+      return errno;
+    }
+    rs->rels = rel;
+    rs->alloc = nalloc;
+  }
+  rel = &rs->rels[rs->count];
+  memset(rel,0,sizeof(*rel));
+  if((rel->prefix = strndup(name,prefixlen)) == NULL){
+    return errno;
+  }
+  rel->prefixlen = prefixlen;
+  if((fd = openat(dirfd,name,O_RDONLY|O_CLOEXEC)) < 0){
+    r = errno;
+    free(rel->prefix);
+    return r;
+  }
+  if((fp = fdopen(fd,"r")) == NULL){
+    r = errno;
+    close(fd);
+    free(rel->prefix);
+    return r;
+  }
+  r = parse_release(fp,&rel->paths);
+  fclose(fp);
+  if(r){
+    strv_free(&rel->paths);
+    free(rel->prefix);
+    return r;
+  }
+  strv_sort(&rel->paths);
+  ++rs->count;
+  return 0;
+}
+
+void free_releaseset(releaseset *rs){
+  while(rs->count){
+    release *rel = &rs->rels[--rs->count];
+
+    strv_free(&rel->paths);
+    free(rel->prefix);
+  }
+  free(rs->rels);
+  rs->rels = NULL;
+  rs->alloc = 0;
+}
+
+// apt's URItoFileName() escaping: unsafe characters are %-escaped, and
+// slashes become underscores.
+static char *
+escape_name(char *p,const char *s,size_t len){
+  while(len--){
+    unsigned char c = *s++;
+
+    if(c == '/'){
+      *p++ = '_';
+    }else if(c <= 0x20 || c >= 0x7f || strchr("\\|{}[]<>\"^~_=!@#$%^&*",c)){
+      p += sprintf(p,"%%%02x",c);
+    }else{
+      *p++ = c;
+    }
+  }
+  return p;
+}
+
+// The filename prefix of the suite's lists: the URI without its scheme,
+// credentials or trailing slashes, then "dists", then the suite.
+static char *
+source_prefix(const char *uri,size_t urilen,const char *suite,size_t suitelen){
+  const char *end = uri + urilen,*host = uri,*colon,*slash,*at;
+  char *prefix,*p;
+
+  if( (colon = memchr(uri,':',urilen)) ){
+    host = colon + 1;
+    if(end - host >= 2 && host[0] == '/' && host[1] == '/'){
+      host += 2;
+    }
+  }
+  if((slash = memchr(host,'/',end - host)) == NULL){
+    slash = end;
+  }
+  for(at = slash ; at > host ; --at){
+    if(at[-1] == '@'){
+      host = at;
+      break;
+    }
+  }
+  while(end > host && end[-1] == '/'){
+    --end;
+  }
+  if((prefix = malloc((end - host) * 3 + strlen("_dists_") + suitelen * 3 + 1)) == NULL){
+    return NULL;
+  }
+  p = escape_name(prefix,host,end - host);
+  p = stpcpy(p,"_dists_");
+  p = escape_name(p,suite,suitelen);
+  *p = '\0';
+  return prefix;
+}
+
+static int
+strv_copy(strv *dst,const strv *src){
+  unsigned z;
+  int r = 0;
+
+  for(z = 0 ; r == 0 && z < src->count ; ++z){
+    r = strv_add(dst,src->v[z],strlen(src->v[z]));
+  }
+  return r;
+}
+
+// Flat repositories (whose suite ends in a slash) have no dists, and their
+// lists are never considered; they're ignored here.
+static int
+add_source(aptsources *as,int src,const char *uri,size_t urilen,
+           const char *suite,size_t suitelen,const strv *comps,
+           const strv *archs){
+  aptsource *s;
+  int r;
+
+  if(suitelen == 0 || suite[suitelen - 1] == '/'){
+    return 0;
+  }
+  if(as->count == as->alloc){
+    unsigned nalloc = as->alloc ? as->alloc * 2 : 8;
+
+    if((s = realloc(as->srcs,sizeof(*s) * nalloc)) == NULL){
+      return errno;
+    }
+    as->srcs = s;
+    as->alloc = nalloc;
+  }
+  s = &as->srcs[as->count];
+  memset(s,0,sizeof(*s));
+  s->src = src;
+  if((s->prefix = source_prefix(uri,urilen,suite,suitelen)) == NULL){
+    return errno;
+  }
+  s->prefixlen = strlen(s->prefix);
+  if((r = strv_copy(&s->components,comps)) || (r = strv_copy(&s->archs,archs))){
+    strv_free(&s->components);
+    strv_free(&s->archs);
+    free(s->prefix);
+    return r;
+  }
+  ++as->count;
+  return 0;
+}
+
+static int
+source_type(const char *tok,size_t len,int *src){
+  if(len == strlen("deb") && strncmp(tok,"deb",len) == 0){
+    *src = 0;
+  }else if(len == strlen("deb-src") && strncmp(tok,"deb-src",len) == 0){
+    *src = 1;
+  }else{
+    return -1;
+  }
+  return 0;
+}
+
+// One-line style: "deb [ option=value ... ] uri suite [component ...]".
+// Of the options, only arch= and arch+= are of interest.
+static int
+parse_source_line(aptsources *as,const char *line){
+  strv comps = { .v = NULL, },archs = { .v = NULL, };
+  const char *s = line,*tok,*uri,*suite;
+  size_t len,urilen,suitelen;
+  int src,r = 0;
+
+  if((tok = next_token(&s,&len)) == NULL || source_type(tok,len,&src)){
+    return 0;
+  }
+  if((tok = next_token(&s,&len)) == NULL){
+    return 0;
+  }
+  if(*tok == '['){ // options may contain whitespace
+    const char *close,*o;
+    size_t olen;
+
+    if((close = strchr(tok,']')) == NULL){
+      return 0;
+    }
+    char opts[close - tok];
+
+    memcpy(opts,tok + 1,close - tok - 1);
+    opts[close - tok - 1] = '\0';
+    for(o = opts ; r == 0 && (tok = next_token(&o,&olen)) ; ){
+      if(strncmp(tok,"arch=",5) == 0){
+        r = strv_split(&archs,tok + 5,olen - 5);
+      }else if(strncmp(tok,"arch+=",6) == 0){
+        r = strv_split(&archs,tok + 6,olen - 6);
+      }
+    }
+    s = close + 1;
+    if(r || (tok = next_token(&s,&len)) == NULL){
+      strv_free(&archs);
+      return r;
+    }
+  }
+  uri = tok;
+  urilen = len;
+  if( (suite = next_token(&s,&suitelen)) ){
+    r = strv_split(&comps,s,strlen(s));
+    if(r == 0){
+      r = add_source(as,src,uri,urilen,suite,suitelen,&comps,&archs);
+    }
+  }
+  strv_free(&comps);
+  strv_free(&archs);
+  return r;
+}
+
+// The deb822 fields we care about, each a list of values.
+enum {
+  FIELD_TYPES,
+  FIELD_URIS,
+  FIELD_SUITES,
+  FIELD_COMPONENTS,
+  FIELD_ARCHITECTURES,
+  FIELD_ENABLED,
+  FIELD_COUNT,
+};
+
+static int
+emit_stanza(aptsources *as,strv *fields){
+  unsigned t,u,s;
+  int src,r = 0;
+
+  if(fields[FIELD_ENABLED].count && strcasecmp(fields[FIELD_ENABLED].v[0],"no") == 0){
+    return 0;
+  }
+  for(t = 0 ; t < fields[FIELD_TYPES].count ; ++t){
+    const char *type = fields[FIELD_TYPES].v[t];
+
+    if(source_type(type,strlen(type),&src)){
+      continue;
+    }
+    for(u = 0 ; u < fields[FIELD_URIS].count ; ++u){
+      const char *uri = fields[FIELD_URIS].v[u];
+
+      for(s = 0 ; s < fields[FIELD_SUITES].count ; ++s){
+        const char *suite = fields[FIELD_SUITES].v[s];
+
+        if( (r = add_source(as,src,uri,strlen(uri),suite,strlen(suite),
+                            &fields[FIELD_COMPONENTS],
+                            &fields[FIELD_ARCHITECTURES])) ){
+          return r;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+// deb822 style: stanzas of "Field: values" separated by blank lines. Values
+// may continue onto indented lines.
+static int
+parse_deb822(aptsources *as,FILE *fp){
+  const char *names[FIELD_COUNT] = {
+    "Types", "URIs", "Suites", "Components", "Architectures", "Enabled",
+  };
+  strv fields[FIELD_COUNT];
+  char *line = NULL;
+  int cur = -1,r = 0;
+  size_t cap = 0;
+  ssize_t len;
+  unsigned f;
+
+  memset(fields,0,sizeof(fields));
+  while(r == 0 && (len = getline(&line,&cap,fp)) >= 0){
+    char *hash,*colon;
+
+    if( (hash = strchr(line,'#')) ){
+      if(hash == line){
+        continue; // a comment, which doesn't end the stanza
+      }
+      *hash = '\0';
+      len = hash - line;
+    }
+    if((len = chomp(line,len)) == 0){
+      r = emit_stanza(as,fields);
+      for(f = 0 ; f < FIELD_COUNT ; ++f){
+        strv_free(&fields[f]);
+      }
+      cur = -1;
+      continue;
+    }
+    if(isspace((unsigned char)line[0])){
+      if(cur >= 0){
+        r = strv_split(&fields[cur],line,len);
+      }
+      continue;
+    }
+    cur = -1;
+    if((colon = strchr(line,':')) == NULL){
+      continue;
+    }
+    for(f = 0 ; f < FIELD_COUNT ; ++f){
+      if(strlen(names[f]) == (size_t)(colon - line) &&
+          strncasecmp(line,names[f],colon - line) == 0){
+        cur = f;
+        r = strv_split(&fields[f],colon + 1,len - (colon + 1 - line));
+        break;
+      }
+    }
+  }
+  if(r == 0 && ferror(fp)){
+    r = errno ? errno : EIO;
+  }
+  if(r == 0){
+    r = emit_stanza(as,fields);
+  }
+  for(f = 0 ; f < FIELD_COUNT ; ++f){
+    strv_free(&fields[f]);
+  }
+  free(line);
+  return r;
+}
+
+static int
+load_sourcefile(aptsources *as,const char *path,int deb822){
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+  FILE *fp;
+  int r = 0;
+
+  if((fp = fopen(path,"re")) == NULL){
+    return errno;
+  }
+  if(deb822){
+    r = parse_deb822(as,fp);
+  }else{
+    while(r == 0 && (len = getline(&line,&cap,fp)) >= 0){
+      char *hash;
+
+      if( (hash = strchr(line,'#')) ){
+        *hash = '\0';
+      }
+      r = parse_source_line(as,line);
+    }
+    if(r == 0 && ferror(fp)){
+      r = errno ? errno : EIO;
+    }
+    free(line);
+  }
+  fclose(fp);
+  return r;
+}
+
+static int
+has_suffix(const char *name,const char *suffix){
+  size_t nlen = strlen(name),slen = strlen(suffix);
+
+  return nlen > slen && strcmp(name + nlen - slen,suffix) == 0;
+}
+
+int load_sources(aptsources *as,const char *path){
+  size_t plen = strlen(path);
+  char dpath[plen + 3];
+  struct dirent *dent;
+  int r = 0;
+  DIR *d;
+
+  if((r = load_sourcefile(as,path,0)) && r != ENOENT){
+    return r;
+  }
+  memcpy(dpath,path,plen);
+  strcpy(dpath + plen,".d");
+  if((d = opendir(dpath)) == NULL){
+    return errno == ENOENT ? 0 : errno;
+  }
+  r = 0;
+  while(r == 0 && (errno = 0, (dent = readdir(d)) != NULL)){
+    char fpath[plen + 3 + strlen(dent->d_name) + 1];
+    int deb822;
+
+    if(has_suffix(dent->d_name,".sources")){
+      deb822 = 1;
+    }else if(has_suffix(dent->d_name,".list")){
+      deb822 = 0;
+    }else{
+      continue;
+    }
+    sprintf(fpath,"%s/%s",dpath,dent->d_name);
+    r = load_sourcefile(as,fpath,deb822);
+  }
+  if(r == 0 && errno){
+    r = errno;
+  }
+  closedir(d);
+  return r;
+}
+
+void free_aptsources(aptsources *as){
+  while(as->count){
+    aptsource *s = &as->srcs[--as->count];
+
+    strv_free(&s->components);
+    strv_free(&s->archs);
+    free(s->prefix);
+  }
+  free(as->srcs);
+  as->srcs = NULL;
+  as->alloc = 0;
+}
+
+// Is the list named by the first len characters of name, of a distribution
+// ending at prefixlen, covered by prefix?
+static inline int
+covers(const char *prefix,size_t prefixlen,const char *name,size_t len){
+  return prefixlen < len && name[prefixlen] == '_' &&
+          strncmp(prefix,name,prefixlen) == 0;
+}
+
+// Does a source name the list, whose prefix (through its distribution) is
+// the first prefixlen characters of name?
+static int
+source_names(const aptsources *as,const char *name,size_t prefixlen,int src,
+             const char *comp,const char *arch){
+  unsigned z;
+
+  for(z = 0 ; z < as->count ; ++z){
+    const aptsource *s = &as->srcs[z];
+
+    if(s->src != src || s->prefixlen != prefixlen ||
+        strncmp(s->prefix,name,prefixlen)){
+      continue;
+    }
+    if(!strv_contains(&s->components,comp)){
+      continue;
+    }
+    if(src || s->archs.count == 0 || strv_contains(&s->archs,arch)){
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Undo apt's escaping of the URI, recovering e.g. "deb.debian.org/debian".
+static char *
+unescape_uri(const char *s,size_t len){
+  char *uri,*p;
+
+  if((p = uri = malloc(len + 1)) == NULL){
+    return NULL;
+  }
+  while(len){
+    if(*s == '_'){
+      *p++ = '/';
+      ++s;
+      --len;
+    }else if(*s == '%' && len >= 3 && isxdigit((unsigned char)s[1]) &&
+              isxdigit((unsigned char)s[2])){
+      const char hex[3] = { s[1], s[2], '\0', };
+
+      *p++ = strtoul(hex,NULL,16);
+      s += 3;
+      len -= 3;
+    }else{
+      *p++ = *s++;
+      --len;
+    }
+  }
+  *p = '\0';
+  return uri;
+}
+
+static char *
+slashed(const char *s,size_t len){
+  char *dup,*p;
+
+  if( (dup = strndup(s,len)) ){
+    for(p = dup ; (p = strchr(p,'_')) ; ++p){
+      *p = '/';
+    }
+  }
+  return dup;
+}
+
+// The distribution is delimited by a Release file's or source's prefix when
+// one covers the list (distributions such as "bookworm/updates" contain
+// underscores once escaped), and otherwise runs to the next underscore. The
+// remainder must be "<component>_binary-<arch>_Packages" or
+// "<component>_source_Sources".
+int classify_list(const char *name,size_t len,const releaseset *rs,
+                  const aptsources *as,listmeta *lm,int *err){
+  const char *end = name + len,*dists,*dist,*distend = NULL;
+  size_t prefixlen = 0,pathlen,complen,archlen;
+  const release *rel = NULL;
+  unsigned z;
+  int src;
+
+  if((dists = strstr(name,"_dists_")) == NULL || dists >= end){
+    return 0;
+  }
+  dist = dists + strlen("_dists_");
+  for(z = 0 ; z < rs->count ; ++z){
+    const release *r = &rs->rels[z];
+
+    if(r->prefixlen > prefixlen && covers(r->prefix,r->prefixlen,name,len)){
+      rel = r;
+      prefixlen = r->prefixlen;
+    }
+  }
+  for(z = 0 ; as && z < as->count ; ++z){
+    const aptsource *s = &as->srcs[z];
+
+    if(s->prefixlen > prefixlen && covers(s->prefix,s->prefixlen,name,len)){
+      prefixlen = s->prefixlen;
+    }
+  }
+  if(prefixlen){
+    distend = name + prefixlen;
+  }else if((distend = memchr(dist,'_',end - dist)) == NULL){
+    return 0;
+  }
+  if(distend <= dist){
+    return 0;
+  }
+  pathlen = end - distend - 1;
+  char path[pathlen + 1],arch[pathlen + 1];
+
+  memcpy(path,distend + 1,pathlen);
+  path[pathlen] = '\0';
+  for(z = 0 ; z < pathlen ; ++z){
+    if(path[z] == '_'){
+      path[z] = '/';
+    }
+  }
+  if(has_suffix(path,"/source/Sources")){
+    src = 1;
+    complen = pathlen - strlen("/source/Sources");
+    strcpy(arch,"source");
+  }else if(has_suffix(path,"/Packages")){
+    char *binary;
+
+    src = 0;
+    path[pathlen - strlen("/Packages")] = '\0';
+    binary = strrchr(path,'/');
+    if(binary == NULL || strncmp(binary + 1,"binary-",7) || binary[8] == '\0'){
+      return 0;
+    }
+    complen = binary - path;
+    archlen = pathlen - strlen("/Packages") - (binary + 8 - path);
+    memcpy(arch,binary + 8,archlen);
+    arch[archlen] = '\0';
+    path[pathlen - strlen("/Packages")] = '/';
+  }else{
+    return 0;
+  }
+  if(rel && !strv_search(&rel->paths,path)){
+    return 0;
+  }
+  char comp[complen + 1];
+
+  memcpy(comp,path,complen);
+  comp[complen] = '\0';
+  if(as && !source_names(as,name,distend - name,src,comp,arch)){
+    return 0;
+  }
+  memset(lm,0,sizeof(*lm));
+  if((lm->uri = unescape_uri(name,dists - name)) == NULL ||
+      (lm->dist = slashed(dist,distend - dist)) == NULL ||
+      (lm->component = strdup(comp)) == NULL ||
+      (lm->arch = strdup(arch)) == NULL){
+    *err = errno;
+    free_listmeta(lm);
+    return -1;
+  }
+  return 1;
+}
+
+void free_listmeta(listmeta *lm){
+  free(lm->uri);
+  free(lm->dist);
+  free(lm->component);
+  free(lm->arch);
+  memset(lm,0,sizeof(*lm));
+}
@@ -0,0 +1,73 @@
+#ifndef RAPTORIAL_SOURCES
+#define RAPTORIAL_SOURCES
+
+// private apt sources.list and Release parsing for raptorial
+#include <stddef.h>
+
+typedef struct strv {
+  char **v;
+  unsigned count,alloc;
+} strv;
+
+int strv_contains(const strv *,const char *);
+
+// The index files named by a Release or InRelease file of a lists directory.
+typedef struct release {
+  char *prefix;  // the lists' filename prefix, through "_dists_<dist>"
+  size_t prefixlen;
+  strv paths;    // e.g. "main/binary-amd64/Packages", sorted, uncompressed
+} release;
+
+typedef struct releaseset {
+  release *rels;
+  unsigned count,alloc;
+} releaseset;
+
+// A single (type, URI, suite) of a sources.list line or deb822 stanza.
+typedef struct aptsource {
+  int src;        // deb-src rather than deb
+  char *prefix;   // the lists' filename prefix, through "_dists_<suite>"
+  size_t prefixlen;
+  strv components;
+  strv archs;     // from arch= or Architectures:, empty if unrestricted
+} aptsource;
+
+typedef struct aptsources {
+  aptsource *srcs;
+  unsigned count,alloc;
+} aptsources;
+
+// What a list's filename and metadata say about it. All are allocated.
+typedef struct listmeta {
+  char *uri;       // e.g. "deb.debian.org/debian"
+  char *dist;      // e.g. "bookworm", or "bookworm/updates"
+  char *component; // e.g. "main"
+  char *arch;      // e.g. "amd64", or "source" for a Sources list
+} listmeta;
+
+// Is the filename that of a Release or InRelease file?
+int is_release_name(const char *);
+
+// Parse the named Release or InRelease file, relative to the directory fd,
+// into the set. A second file for the same distribution (i.e. both Release
+// and InRelease) is ignored. Returns 0 on success, or an error code.
+int add_release(releaseset *,int,const char *);
+void free_releaseset(releaseset *);
+
+// Parse the sources.list at the path, and every *.list and *.sources file
+// in the directory named by the path suffixed with ".d". Either may be
+// absent. Returns 0 on success, or an error code.
+int load_sources(aptsources *,const char *);
+void free_aptsources(aptsources *);
+
+// Classify the list named by the first len characters of name (i.e. without
+// any compression suffix). If a Release file of rs covers the list's
+// distribution, the list must be one of its indices; if as is non-NULL, the
+// list must be named by one of its sources. Returns 1 if the list is live,
+// filling in lm; 0 if it is stale or unrecognized; -1 on error, writing the
+// error through.
+int classify_list(const char *,size_t,const releaseset *,const aptsources *,
+                  listmeta *,int *);
+void free_listmeta(listmeta *);
+
+#endif
@@ -0,0 +1,319 @@
+#define _GNU_SOURCE // CPU_ALLOC() and pthread_attr_setaffinity_np()
+#include <threadpool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <util.h>
+
+// A run awaiting (or occupying) the pool's threads. It lives on the caller's
+// stack until running hits 0 with finished set.
+typedef struct pooljob {
+  void *(*fxn)(void *);
+  void *arg;
+  unsigned want;    // invocations yet to be started
+  unsigned running; // invocations underway on the pool's threads
+  int finished;     // an invocation has returned; start no more
+  int failed;       // an invocation returned NULL
+  struct pooljob *next;
+} pooljob;
+
+// Threads record the pool they belong to, so that runs they submit to it
+// don't wait on themselves.
+static __thread struct raptorial_pool *curpool;
+
+unsigned threadpool_width(const struct raptorial_pool *rp){
+  unsigned pes = online_pes();
+
+  if(rp && rp->threads < pes){
+    return rp->threads;
+  }
+  return pes;
+}
+
+// Called with the lock held.
+static void
+unlink_job(struct raptorial_pool *rp,pooljob *job){
+  pooljob **pj;
+
+  for(pj = &rp->jobs ; *pj ; pj = &(*pj)->next){
+    if(*pj == job){
+      *pj = job->next;
+      break;
+    }
+  }
+}
+
+static void *
+pool_thread(void *vrp){
+  struct raptorial_pool *rp = vrp;
+  pooljob *job;
+  void *rv;
+
+  curpool = rp;
+  pthread_mutex_lock(&rp->lock);
+  for(;;){
+    while(rp->jobs == NULL && !rp->stopping){
+      pthread_cond_wait(&rp->cond,&rp->lock);
+    }
+    if((job = rp->jobs) == NULL){
+      break;
+    }
+    if(--job->want == 0){
+      rp->jobs = job->next;
+    }
+    ++job->running;
+    pthread_mutex_unlock(&rp->lock);
+    rv = job->fxn(job->arg);
+    pthread_mutex_lock(&rp->lock);
+    if(rv == NULL){
+      job->failed = 1;
+    }
+    if(!job->finished){
+      job->finished = 1;
+      if(job->want){
+        unlink_job(rp,job);
+        job->want = 0;
+      }
+    }
+    if(--job->running == 0){
+      pthread_cond_broadcast(&rp->done);
+    }
+  }
+  pthread_mutex_unlock(&rp->lock);
+  return rp;
+}
+
+int threadpool_run(struct raptorial_pool *rp,unsigned threads,
+                   void *(*fxn)(void *),void *arg,int *err){
+  int inpool = curpool == rp;
+  pooljob job = {
+    .fxn = fxn,
+    .arg = arg,
+  };
+
+  if(threads == 0){
+    threads = 1;
+  }
+  if(threads > rp->threads){
+    threads = rp->threads;
+  }
+  job.want = threads - inpool;
+  pthread_mutex_lock(&rp->lock);
+  if(job.want){
+    pooljob **pj;
+
+    for(pj = &rp->jobs ; *pj ; pj = &(*pj)->next){
+      ;
+    }
+    *pj = &job;
+    pthread_cond_broadcast(&rp->cond);
+  }
+  if(inpool){
+    pthread_mutex_unlock(&rp->lock);
+    if(fxn(arg) == NULL){
+      job.failed = 1;
+    }
+    pthread_mutex_lock(&rp->lock);
+    if(!job.finished){
+      job.finished = 1;
+      if(job.want){
+        unlink_job(rp,&job);
+        job.want = 0;
+      }
+    }
+  }
+  while(!job.finished || job.running){
+    pthread_cond_wait(&rp->done,&rp->lock);
+  }
+  pthread_mutex_unlock(&rp->lock);
+  if(job.failed){
+    *err = EINVAL;
+    return -1;
+  }
+  return 0;
+}
+
+// Add the CPUs of a kernel cpulist (e.g. "0-3,8,10-11") to the set.
+static int
+parse_cpulist(const char *s,cpu_set_t *set,size_t setsize){
+  unsigned long lo,hi;
+  char *end;
+
+  while(*s && *s != '\n'){
+    lo = strtoul(s,&end,10);
+    if(end == s){
+      return EINVAL;
+    }
+    hi = lo;
+    if(*end == '-'){
+      s = end + 1;
+      hi = strtoul(s,&end,10);
+      if(end == s || hi < lo){
+        return EINVAL;
+      }
+    }
+    for( ; lo <= hi ; ++lo){
+      if(lo >= setsize * 8){
+        return EINVAL;
+      }
+      CPU_SET_S(lo,setsize,set);
+    }
+    s = end;
+    if(*s == ','){
+      ++s;
+    }
+  }
+  return 0;
+}
+
+static int
+add_node_cpus(unsigned node,cpu_set_t *set,size_t setsize){
+  char path[64],buf[4096];
+  ssize_t r;
+  int fd;
+
+  snprintf(path,sizeof(path),"/sys/devices/system/node/node%u/cpulist",node);
+  if((fd = open(path,O_RDONLY|O_CLOEXEC)) < 0){
+    return errno;
+  }
+  r = read(fd,buf,sizeof(buf) - 1);
+  close(fd);
+  if(r < 0){
+    return errno;
+  }
+  buf[r] = '\0';
+  return parse_cpulist(buf,set,setsize);
+}
+
+// Pin the attr to the requested CPUs and nodes, if any, returning the
+// number of CPUs through cpus (0 if not pinned).
+static int
+pin_attr(pthread_attr_t *attr,const raptorial_poolopts *opts,unsigned *cpus){
+  long conf = sysconf(_SC_NPROCESSORS_CONF);
+  unsigned ncpus,z;
+  cpu_set_t *set;
+  size_t setsize;
+  int r = 0;
+
+  *cpus = 0;
+  if(opts == NULL || (opts->cpucount == 0 && opts->nodecount == 0)){
+    return 0;
+  }
+  ncpus = conf > 0 ? conf : 1;
+  for(z = 0 ; z < opts->cpucount ; ++z){
+    if(opts->cpus[z] >= ncpus){
+      ncpus = opts->cpus[z] + 1;
+    }
+  }
+  if((set = CPU_ALLOC(ncpus)) == NULL){
+    return errno;
+  }
+  setsize = CPU_ALLOC_SIZE(ncpus);
+  CPU_ZERO_S(setsize,set);
+  for(z = 0 ; z < opts->cpucount ; ++z){
+    CPU_SET_S(opts->cpus[z],setsize,set);
+  }
+  for(z = 0 ; r == 0 && z < opts->nodecount ; ++z){
+    r = add_node_cpus(opts->nodes[z],set,setsize);
+  }
+  if(r == 0 && (*cpus = CPU_COUNT_S(setsize,set)) == 0){
+    r = EINVAL;
+  }
+  if(r == 0){
+    r = pthread_attr_setaffinity_np(attr,setsize,set);
+  }
+  CPU_FREE(set);
+  return r;
+}
+
+static void
+stop_threads(struct raptorial_pool *rp,unsigned started){
+  unsigned z;
+
+  pthread_mutex_lock(&rp->lock);
+  rp->stopping = 1;
+  pthread_cond_broadcast(&rp->cond);
+  pthread_mutex_unlock(&rp->lock);
+  for(z = 0 ; z < started ; ++z){
+    pthread_join(rp->tids[z],NULL);
+  }
+}
+
+PUBLIC struct raptorial_pool *
+raptorial_pool_create(const raptorial_poolopts *opts,int *err){
+  struct raptorial_pool *rp;
+  unsigned cpus,z;
+  int r;
+
+  if((rp = malloc(sizeof(*rp))) == NULL){
+    *err = errno;
+    return NULL;
+  }
+  memset(rp,0,sizeof(*rp));
+  if( (r = pthread_attr_init(&rp->attr)) ){
+    *err = r;
+    free(rp);
+    return NULL;
+  }
+  if( (r = pin_attr(&rp->attr,opts,&cpus)) ){
+    goto err_attr;
+  }
+  rp->pinned = cpus != 0;
+  if(opts && opts->threads){
+    rp->threads = opts->threads;
+  }else{
+    rp->threads = cpus ? cpus : online_pes();
+  }
+  if((rp->tids = malloc(sizeof(*rp->tids) * rp->threads)) == NULL){
+    r = errno;
+    goto err_attr;
+  }
+  if( (r = pthread_mutex_init(&rp->lock,NULL)) ){
+    goto err_tids;
+  }
+  if( (r = pthread_cond_init(&rp->cond,NULL)) ){
+    goto err_lock;
+  }
+  if( (r = pthread_cond_init(&rp->done,NULL)) ){
+    goto err_cond;
+  }
+  for(z = 0 ; z < rp->threads ; ++z){
+    if( (r = pthread_create(&rp->tids[z],rp->pinned ? &rp->attr : NULL,
+                            pool_thread,rp)) ){
+      stop_threads(rp,z);
+      goto err_done;
+    }
+  }
+  return rp;
+
+err_done:
+  pthread_cond_destroy(&rp->done);
+err_cond:
+  pthread_cond_destroy(&rp->cond);
+err_lock:
+  pthread_mutex_destroy(&rp->lock);
+err_tids:
+  free(rp->tids);
+err_attr:
+  pthread_attr_destroy(&rp->attr);
+  free(rp);
+  *err = r;
+  return NULL;
+}
+
+PUBLIC void
+raptorial_pool_free(struct raptorial_pool *rp){
+  if(rp){
+    stop_threads(rp,rp->threads);
+    pthread_cond_destroy(&rp->done);
+    pthread_cond_destroy(&rp->cond);
+    pthread_mutex_destroy(&rp->lock);
+    pthread_attr_destroy(&rp->attr);
+    free(rp->tids);
+    free(rp);
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef RAPTORIAL_THREADPOOL
+#define RAPTORIAL_THREADPOOL
+
+// private implementation of raptorial_pool, a set of persistent threads
+#include <pthread.h>
+#include <raptorial.h>
+
+struct pooljob;
+
+struct raptorial_pool {
+  unsigned threads;
+  pthread_t *tids;
+  // Carries the pool's affinity (if pinned), both for its own threads and
+  // for any helper threads launched on its behalf.
+  pthread_attr_t attr;
+  int pinned;
+
+  // The lock protects everything below. Idle threads wait on cond for jobs
+  // (or to be stopped), and callers wait on done for their jobs to finish.
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_cond_t done;
+  struct pooljob *jobs; // awaiting threads, oldest first
+  int stopping;
+};
+
+// The most threads a run may use: no more than the pool has, nor than there
+// are processing elements. The pool may be NULL, in which case it's the
+// latter alone.
+unsigned threadpool_width(const struct raptorial_pool *);
+
+// Run the function on up to the specified number of the pool's threads, with
+// the semantics of run_threads(). Any number of invocations must be able to
+// complete the work between them, and once one has returned, no more are
+// started. A caller outside the pool only waits; one of the pool's own
+// threads runs an invocation itself, and so can never wait on a pool which
+// its peers have left busy.
+int threadpool_run(struct raptorial_pool *,unsigned,void *(*)(void *),void *,
+                   int *);
+
+#endif
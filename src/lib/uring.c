@@ -0,0 +1,282 @@
+#include <uring.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_IO_URING
+#include <util.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/stat.h>
+#include <linux/io_uring.h>
+
+#ifndef AT_EMPTY_PATH // only exposed by fcntl.h under _GNU_SOURCE
+#define AT_EMPTY_PATH 0x1000
+#endif
+
+// We speak to the kernel directly, rather than through liburing. The rings
+// are shared with the kernel: it consumes the submission queue from its head
+// and fills the completion queue at its tail, while we own the others.
+
+enum {
+  STAGE_OPEN,
+  STAGE_STATX,
+  STAGE_READ,
+};
+
+int uring_init(uring *u,unsigned entries){
+  struct io_uring_params p;
+  int r;
+
+  memset(u,0,sizeof(*u));
+  memset(&p,0,sizeof(p));
+  if((u->fd = syscall(__NR_io_uring_setup,entries,&p)) < 0){
+    return errno;
+  }
+  // IORING_OP_OPENAT, IORING_OP_STATX and IORING_OP_READ arrived in 5.6,
+  // along with IORING_FEAT_RW_CUR_POS.
+  if(!(p.features & IORING_FEAT_RW_CUR_POS)){
+    close(u->fd);
+    return ENOSYS;
+  }
+  u->entries = p.sq_entries;
+  u->sqmaplen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  u->cqmaplen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  u->sqeslen = p.sq_entries * sizeof(struct io_uring_sqe);
+  if(p.features & IORING_FEAT_SINGLE_MMAP){
+    if(u->cqmaplen > u->sqmaplen){
+      u->sqmaplen = u->cqmaplen;
+    }
+    u->cqmaplen = 0;
+  }
+  u->sqmap = mmap(NULL,u->sqmaplen,PROT_READ|PROT_WRITE,
+                  MAP_SHARED|MAP_POPULATE,u->fd,IORING_OFF_SQ_RING);
+  if(u->sqmap == MAP_FAILED){
+    goto err;
+  }
+  u->cqmap = u->sqmap;
+  if(u->cqmaplen){
+    u->cqmap = mmap(NULL,u->cqmaplen,PROT_READ|PROT_WRITE,
+                    MAP_SHARED|MAP_POPULATE,u->fd,IORING_OFF_CQ_RING);
+    if(u->cqmap == MAP_FAILED){
+      goto sqerr;
+    }
+  }
+  u->sqes = mmap(NULL,u->sqeslen,PROT_READ|PROT_WRITE,
+                 MAP_SHARED|MAP_POPULATE,u->fd,IORING_OFF_SQES);
+  if(u->sqes == MAP_FAILED){
+    goto cqerr;
+  }
+  u->sqhead = (unsigned *)((char *)u->sqmap + p.sq_off.head);
+  u->sqtail = (unsigned *)((char *)u->sqmap + p.sq_off.tail);
+  u->sqmask = (unsigned *)((char *)u->sqmap + p.sq_off.ring_mask);
+  u->sqarray = (unsigned *)((char *)u->sqmap + p.sq_off.array);
+  u->cqhead = (unsigned *)((char *)u->cqmap + p.cq_off.head);
+  u->cqtail = (unsigned *)((char *)u->cqmap + p.cq_off.tail);
+  u->cqmask = (unsigned *)((char *)u->cqmap + p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe *)((char *)u->cqmap + p.cq_off.cqes);
+  u->sqlocal = *u->sqtail;
+  return 0;
+
+cqerr:
+  r = errno;
+  if(u->cqmaplen){
+    munmap(u->cqmap,u->cqmaplen);
+  }
+  errno = r;
+sqerr:
+  r = errno;
+  munmap(u->sqmap,u->sqmaplen);
+  errno = r;
+err:
+  r = errno;
+  close(u->fd);
+  return r;
+}
+
+void uring_free(uring *u){
+  munmap(u->sqes,u->sqeslen);
+  if(u->cqmaplen){
+    munmap(u->cqmap,u->cqmaplen);
+  }
+  munmap(u->sqmap,u->sqmaplen);
+  close(u->fd);
+}
+
+// The caller never has more operations in flight than the ring has entries,
+// so there's always room.
+static struct io_uring_sqe *
+get_sqe(uring *u,unsigned idx){
+  unsigned slot = u->sqlocal++ & *u->sqmask;
+  struct io_uring_sqe *sqe = &u->sqes[slot];
+
+  memset(sqe,0,sizeof(*sqe));
+  u->sqarray[slot] = slot;
+  sqe->user_data = idx;
+  return sqe;
+}
+
+// Hand the kernel what we've queued, and wait for at least one completion.
+static int
+submit_and_wait(uring *u){
+  __atomic_store_n(u->sqtail,u->sqlocal,__ATOMIC_RELEASE);
+  // Anything the kernel hasn't yet consumed is resubmitted.
+  while(syscall(__NR_io_uring_enter,u->fd,
+                u->sqlocal - __atomic_load_n(u->sqhead,__ATOMIC_ACQUIRE),1,
+                IORING_ENTER_GETEVENTS,NULL,0) < 0){
+    if(errno != EINTR){
+      return errno;
+    }
+  }
+  return 0;
+}
+
+static void
+prep_open(uring *u,int dirfd,uringfile *f,unsigned idx){
+  struct io_uring_sqe *sqe = get_sqe(u,idx);
+
+  f->stage = STAGE_OPEN;
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = dirfd;
+  sqe->addr = (uintptr_t)f->name;
+  sqe->open_flags = O_RDONLY | O_CLOEXEC;
+}
+
+static void
+prep_statx(uring *u,uringfile *f,struct statx *stx,unsigned idx){
+  struct io_uring_sqe *sqe = get_sqe(u,idx);
+
+  f->stage = STAGE_STATX;
+  sqe->opcode = IORING_OP_STATX;
+  sqe->fd = f->fd;
+  sqe->addr = (uintptr_t)"";
+  sqe->len = STATX_SIZE;
+  sqe->off = (uintptr_t)stx;
+  sqe->statx_flags = AT_EMPTY_PATH;
+}
+
+static void
+prep_read(uring *u,uringfile *f,unsigned idx){
+  struct io_uring_sqe *sqe = get_sqe(u,idx);
+
+  f->stage = STAGE_READ;
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = f->fd;
+  sqe->addr = (uintptr_t)((char *)f->buf + f->len);
+  sqe->len = f->alloc - f->len > 1u << 30 ? 1u << 30 : f->alloc - f->len;
+  sqe->off = f->len;
+}
+
+// Advance the file through its stages. Returns 1 if it's finished, having
+// written its error (if any) through.
+static int
+advance(uring *u,uringfile *f,struct statx *stx,unsigned idx,int res,int *err){
+  *err = 0;
+  if(res < 0){
+    *err = -res;
+  }else if(f->stage == STAGE_OPEN){
+    f->fd = res;
+    prep_statx(u,f,stx,idx);
+    return 0;
+  }else if(f->stage == STAGE_STATX){
+    if((f->alloc = stx->stx_size) == 0){
+      *err = ENODATA;
+    }else if((f->buf = mmap(NULL,maplen(f->alloc),PROT_READ|PROT_WRITE,
+                            MAP_PRIVATE|MAP_ANONYMOUS,-1,0)) == MAP_FAILED){
+      f->buf = NULL;
+      *err = errno;
+    }else{
+      prep_read(u,f,idx);
+      return 0;
+    }
+  }else if(res && (f->len += res) < f->alloc){
+    prep_read(u,f,idx);
+    return 0;
+  }
+  if(f->buf && (*err || f->len == 0)){
+    munmap(f->buf,maplen(f->alloc));
+    f->buf = NULL;
+    f->len = 0;
+    if(*err == 0){
+      *err = ENODATA;
+    }
+  }else if(f->buf && maplen(f->len) < maplen(f->alloc)){ // it shrank
+    munmap((char *)f->buf + maplen(f->len),maplen(f->alloc) - maplen(f->len));
+  }
+  if(f->fd >= 0){
+    close(f->fd);
+    f->fd = -1;
+  }
+  return 1;
+}
+
+int uring_read_files(uring *u,int dirfd,uringfile *files,unsigned count,
+                     int (*done)(unsigned,int,void *),void *opaque){
+  unsigned next = 0,inflight = 0,z;
+  struct statx *stx;
+  int r,ret = 0;
+
+  if((stx = malloc(sizeof(*stx) * (count ? count : 1))) == NULL){
+    return errno;
+  }
+  for(z = 0 ; z < count ; ++z){
+    files[z].buf = NULL;
+    files[z].len = 0;
+    files[z].fd = -1;
+  }
+  while(next < count || inflight){
+    unsigned head,tail;
+
+    while(ret == 0 && next < count && inflight < u->entries){
+      prep_open(u,dirfd,&files[next],next);
+      ++next;
+      ++inflight;
+    }
+    if( (r = submit_and_wait(u)) ){
+      // We can't know what the kernel is still doing with our buffers.
+      free(stx);
+      return r;
+    }
+    head = *u->cqhead;
+    tail = __atomic_load_n(u->cqtail,__ATOMIC_ACQUIRE);
+    while(head != tail){
+      const struct io_uring_cqe *cqe = &u->cqes[head & *u->cqmask];
+      unsigned idx = cqe->user_data;
+      int err;
+
+      if(advance(u,&files[idx],&stx[idx],idx,cqe->res,&err)){
+        --inflight;
+        if( (r = done(idx,err,opaque)) && ret == 0 ){
+          ret = r;
+        }
+      }
+      ++head;
+    }
+    __atomic_store_n(u->cqhead,head,__ATOMIC_RELEASE);
+    if(ret){
+      next = count;
+    }
+  }
+  free(stx);
+  return ret;
+}
+#else
+int uring_init(uring *u,unsigned entries __attribute__ ((unused))){
+  u->fd = -1;
+  return ENOSYS;
+}
+
+void uring_free(uring *u __attribute__ ((unused))){
+}
+
+int uring_read_files(uring *u __attribute__ ((unused)),
+                     int dirfd __attribute__ ((unused)),
+                     uringfile *files __attribute__ ((unused)),
+                     unsigned count __attribute__ ((unused)),
+                     int (*done)(unsigned,int,void *) __attribute__ ((unused)),
+                     void *opaque __attribute__ ((unused))){
+  return ENOSYS;
+}
+#endif
@@ -0,0 +1,54 @@
+#ifndef RAPTORIAL_URING
+#define RAPTORIAL_URING
+
+// private batched file reading via io_uring for raptorial
+#include <config.h>
+#include <stddef.h>
+
+// A file to be read whole, relative to a directory fd. Once it's been read,
+// buf is an anonymous mapping holding its len bytes, to be released with
+// munmap(). buf is NULL if the file couldn't be read, or was empty.
+typedef struct uringfile {
+  const char *name;
+  void *buf;
+  size_t len;
+  size_t alloc; // internal: the size found by statx
+  int fd;       // internal
+  int stage;    // internal
+} uringfile;
+
+#ifdef HAVE_IO_URING
+typedef struct uring {
+  int fd;
+  unsigned entries;
+  unsigned *sqhead,*sqtail,*sqmask,*sqarray;
+  unsigned *cqhead,*cqtail,*cqmask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sqmap,*cqmap;
+  size_t sqmaplen,cqmaplen,sqeslen;
+  unsigned sqlocal; // our tail, ahead of *sqtail by unsubmitted entries
+} uring;
+#else
+typedef struct uring {
+  int fd;
+} uring;
+#endif
+
+// Set up a ring with room for the specified number of operations in flight.
+// Returns 0 on success, or an errno value (ENOSYS if we weren't built with
+// io_uring support, or the kernel doesn't allow it), in which case the caller
+// ought fall back to synchronous I/O.
+int uring_init(uring *,unsigned);
+void uring_free(uring *);
+
+// Open, statx and read the files, keeping as many in flight as the ring
+// allows. done is called with each file's index as it completes, along with
+// 0 or the errno value with which it failed; a file which failed can still
+// be read synchronously. If done returns non-zero, no further files are
+// started, and that value is returned once those in flight have completed.
+// Otherwise, returns 0, or an errno value if the ring itself failed.
+int uring_read_files(uring *,int,uringfile *,unsigned,
+                     int (*)(unsigned,int,void *),void *);
+
+#endif
@@ -2,6 +2,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <blossom.h>
+#include <pthread.h>
+#include <threadpool.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 
@@ -21,39 +24,171 @@ size_t maplen(size_t len){
 	return mlen;
 }
 
-void *mapit(const char *path,size_t *len,int *iofd,int huge,int *err){
+unsigned online_pes(void){
+	long pes;
+
+	if((pes = sysconf(_SC_NPROCESSORS_ONLN)) <= 0){
+		return 1;
+	}
+	return pes;
+}
+
+unsigned threads_for_bytes(const struct raptorial_pool *rp,size_t bytes){
+	unsigned pes = threadpool_width(rp);
+	size_t threads = bytes / THREAD_BYTES;
+
+	if(threads == 0){
+		return 1;
+	}
+	return threads > pes ? pes : threads;
+}
+
+int run_threads(struct raptorial_pool *rp,unsigned threads,
+		void *(*fxn)(void *),void *arg,int *err){
+	blossom_ctl bctl = {
+		.flags = 0,
+		.tids = 1,
+	};
+	unsigned started,z;
+	blossom_state bs;
+	int ret = 0;
+
+	if(rp){
+		return threadpool_run(rp,threads,fxn,arg,err);
+	}
+	if(threads == 0){
+		threads = 1;
+	}
+	if(threads > 1 && threads >= online_pes()){
+		if(blossom_per_pe(&bctl,&bs,NULL,fxn,arg)){
+			*err = errno;
+			return -1;
+		}
+		if(blossom_join_all(&bs)){
+			*err = errno;
+			blossom_free_state(&bs);
+			return -1;
+		}
+		if(blossom_validate_joinrets(&bs)){
+			*err = EINVAL;
+			ret = -1;
+		}
+		blossom_free_state(&bs);
+		return ret;
+	}
+	pthread_t tids[threads];
+
+	// If we can't launch them all, those we have (at least we ourselves)
+	// share the work.
+	for(started = 0 ; started + 1 < threads ; ++started){
+		if(pthread_create(&tids[started],NULL,fxn,arg)){
+			break;
+		}
+	}
+	if(fxn(arg) == NULL){
+		*err = EINVAL;
+		ret = -1;
+	}
+	for(z = 0 ; z < started ; ++z){
+		void *rv;
+
+		if(pthread_join(tids[z],&rv) == 0 && rv == NULL && ret == 0){
+			*err = EINVAL;
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
+// Read the whole file into anonymous memory. A file which shrinks beneath
+// us is truncated; one which grows is read only through its original length.
+static void *
+readit(int fd,size_t len,size_t mlen,size_t *rlen,int *err){
+	size_t off = 0;
+	ssize_t r;
+	void *buf;
+
+	if((buf = mmap(NULL,mlen,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0)) == MAP_FAILED){
+		*err = errno;
+		return MAP_FAILED;
+	}
+	while(off < len){
+		if((r = pread(fd,(char *)buf + off,len - off,off)) < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			*err = errno;
+			munmap(buf,mlen);
+			return MAP_FAILED;
+		}
+		if(r == 0){
+			break;
+		}
+		off += r;
+	}
+	if(maplen(off) < mlen){ // it shrank; callers unmap only what's used
+		munmap((char *)buf + maplen(off),mlen - maplen(off));
+	}
+	*rlen = off;
+	return buf;
+}
+
+// Fault in an advised mapping. MADV_POPULATE_READ (Linux 5.14) does so
+// synchronously, as MAP_POPULATE would have; otherwise, start readahead.
+static void
+populate(void *map,size_t mlen){
+#ifdef MADV_POPULATE_READ
+	if(madvise(map,mlen,MADV_POPULATE_READ) == 0){
+		return;
+	}
+#endif
+	madvise(map,mlen,MADV_WILLNEED);
+}
+
+void *mapit(int dirfd,const char *path,size_t *len,int *iofd,raptorial_io io,int *err){
 	struct stat st;
 	size_t mlen;
 	void *map;
 	int fd;
 
-	if((fd = open(path,O_CLOEXEC)) < 0){
+	if((fd = openat(dirfd,path,O_RDONLY|O_CLOEXEC)) < 0){
 		*err = errno;
 		return MAP_FAILED;
 	}
 	if(fstat(fd,&st)){
 		*err = errno;
 		close(fd);
-		return NULL;
+		return MAP_FAILED;
 	}
 	if((mlen = maplen(st.st_size)) == (size_t)-1){
 		*err = errno;
 		close(fd);
-		return NULL;
-	}
-	if(huge){
-		map = mmap(NULL,mlen,PROT_READ,MAP_SHARED|MAP_POPULATE|MAP_HUGETLB,fd,0);
-	}else{
-		map = MAP_FAILED;
+		return MAP_FAILED;
 	}
-	if(map == MAP_FAILED){
-		if((map = mmap(NULL,mlen,PROT_READ,MAP_SHARED|MAP_POPULATE,fd,0)) == MAP_FAILED){
-			*err = errno;
+	*len = st.st_size;
+	if(io == RAPTORIAL_IO_PREAD || io == RAPTORIAL_IO_URING){
+		if((map = readit(fd,st.st_size,mlen,len,err)) == MAP_FAILED){
 			close(fd);
 			return MAP_FAILED;
 		}
+		*iofd = fd;
+		return map;
+	}
+	// Huge pages must be requested before the mapping is populated.
+	map = mmap(NULL,mlen,PROT_READ,io == RAPTORIAL_IO_POPULATE ?
+			MAP_SHARED|MAP_POPULATE : MAP_SHARED,fd,0);
+	if(map == MAP_FAILED){
+		*err = errno;
+		close(fd);
+		return MAP_FAILED;
+	}
+	if(io == RAPTORIAL_IO_LAZY){
+		madvise(map,mlen,MADV_SEQUENTIAL);
+		madvise(map,mlen,MADV_WILLNEED);
+	}else if(io == RAPTORIAL_IO_HUGEPAGE){
+		madvise(map,mlen,MADV_HUGEPAGE);
+		populate(map,mlen);
 	}
-	*len = st.st_size;
 	*iofd = fd;
 	return map;
 }
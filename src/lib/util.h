@@ -4,9 +4,32 @@
 // private utility functions for raptorial
 #include <ctype.h>
 #include <stddef.h>
+#include <raptorial.h>
 
 size_t maplen(size_t);
-void *mapit(const char *,size_t *,int *,int,int *);
+unsigned online_pes(void);
+
+// A thread is only worth starting for this many bytes of input (as lexed,
+// i.e. decompressed), so smaller inputs get fewer threads, and the smallest
+// are lexed inline. Compressed input is counted COMP_RATIO times over. No
+// more threads are used than the pool (which may be NULL) allows.
+#define THREAD_BYTES (256 * 1024)
+#define COMP_RATIO 5
+unsigned threads_for_bytes(const struct raptorial_pool *,size_t);
+
+// Run the function on the specified number of threads, returning once every
+// one has. With a pool, they're the pool's (see threadpool_run()). Otherwise,
+// a thread per processing element is launched through blossom; any fewer are
+// the caller and as many others as are needed, so one thread means none
+// launched at all. Returns 0 if every call returned non-NULL, or -1 with the
+// error (EINVAL, if a call returned NULL) written through.
+int run_threads(struct raptorial_pool *,unsigned,void *(*)(void *),void *,int *);
+
+// Map the file at the path, relative to the directory fd (or AT_FDCWD),
+// according to the I/O strategy. RAPTORIAL_IO_PREAD and RAPTORIAL_IO_URING
+// read the file into an anonymous mapping. Either way, the result is released
+// with munmap(), and MAP_FAILED is returned on error.
+void *mapit(int,const char *,size_t *,int *,raptorial_io,int *);
 
 static inline int
 isdebpkgchar(int c){
@@ -1,6 +1,27 @@
 #include <stdio.h>
+#include <dirent.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <zlib.h>
+#include "config.h"
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
 #include <raptorial.h>
 
 static void
@@ -8,9 +29,1025 @@ usage(const char *name){
 	fprintf(stderr,"usage: %s packagesfile\n",name);
 }
 
+// The list's compression suffix, or NULL if it's uncompressed.
+static const char *
+has_comp_suffix(const char *path){
+	const char * const suffixes[] = { ".gz", ".xz", ".lz4", ".zst", NULL, };
+	size_t len = strlen(path),slen;
+	unsigned z;
+
+	for(z = 0 ; suffixes[z] ; ++z){
+		slen = strlen(suffixes[z]);
+		if(len > slen && strcmp(path + len - slen,suffixes[z]) == 0){
+			return path + len - slen;
+		}
+	}
+	return NULL;
+}
+
+// The path of the list of distribution dist within the directory.
+static void
+list_name(char *name,size_t size,const char *dir,const char *path,const char *dist){
+	const char *suffix = has_comp_suffix(path);
+
+	snprintf(name,size,"%s/example.org_debian_dists_%s_main_binary-amd64_Packages%s",
+			dir,dist,suffix ? suffix : "");
+}
+
+// Link the list into the directory as the named list of distribution dist.
+static int
+link_list(const char *dir,const char *path,const char *dist){
+	char *abspath,name[PATH_MAX];
+	int r;
+
+	if((abspath = realpath(path,NULL)) == NULL){
+		return -1;
+	}
+	list_name(name,sizeof(name),dir,path,dist);
+	r = symlink(abspath,name);
+	free(abspath);
+	return r;
+}
+
+// A temporary lists directory holding the list once for each distribution.
+static char *
+make_listdir(const char *path,const char * const *dists){
+	char *dir;
+
+	if((dir = strdup("/tmp/rapt-tester-XXXXXX")) == NULL){
+		return NULL;
+	}
+	if(mkdtemp(dir) == NULL){
+		free(dir);
+		return NULL;
+	}
+	while(*dists){
+		if(link_list(dir,path,*dists++)){
+			fprintf(stderr,"Couldn't link %s into %s (%s?)\n",path,dir,strerror(errno));
+			return NULL; // left behind for inspection
+		}
+	}
+	return dir;
+}
+
+static void
+remove_listdir(char *dir){
+	struct dirent *d;
+	DIR *dp;
+
+	if( (dp = opendir(dir)) ){
+		while( (d = readdir(dp)) ){
+			if(strcmp(d->d_name,".") && strcmp(d->d_name,"..")){
+				unlinkat(dirfd(dp),d->d_name,0);
+			}
+		}
+		closedir(dp);
+	}
+	rmdir(dir);
+	free(dir);
+}
+
+// The same list lexed twice into a deduplicated cache yields the packages of
+// one copy, each found in both lists, and each list's set spans every name.
+static int
+check_dedup(const char *path){
+	const char * const one[] = { "one", NULL };
+	const char * const two[] = { "one", "two", NULL };
+	const raptorial_lexopts opts = {
+		.flags = RAPTORIAL_LEX_DEDUP | RAPTORIAL_LEX_INDEX,
+	};
+	struct pkgcache *pc1,*pc2;
+	const struct pkglist *pl,*ol;
+	const struct pkgobj *po;
+	struct pkgset *ps;
+	char *dir1,*dir2;
+	unsigned lists;
+	int err;
+
+	if((dir1 = make_listdir(path,one)) == NULL || (dir2 = make_listdir(path,two)) == NULL){
+		return -1;
+	}
+	if((pc1 = lex_packages_dir_opts(dir1,&err,NULL,&opts)) == NULL ||
+			(pc2 = lex_packages_dir_opts(dir2,&err,NULL,&opts)) == NULL){
+		fprintf(stderr,"Couldn't lex deduplicated %s (%s?)\n",path,strerror(err));
+		return -1;
+	}
+	if(pkgcache_count(pc2) != pkgcache_count(pc1) ||
+			pkgcache_names(pc2) != pkgcache_names(pc1)){
+		fprintf(stderr,"Deduplicated package count was inaccurate (%u != %u)\n",
+				pkgcache_count(pc2),pkgcache_count(pc1));
+		return -1;
+	}
+	for(pl = pkgcache_begin(pc2) ; pl ; pl = pkgcache_next(pl)){
+		for(po = pkglist_begin(pl) ; po ; po = pkglist_next(po)){
+			lists = 0;
+			for(ol = pkgobj_originbegin(po) ; ol ; ol = pkgobj_originnext(po,ol)){
+				++lists;
+			}
+			if(lists != 2){
+				fprintf(stderr,"%s found in %u lists\n",pkgobj_name(po),lists);
+				return -1;
+			}
+		}
+		if((ps = pkgset_from_list(pc2,pl,&err)) == NULL ||
+				pkgset_count(ps) != pkgcache_names(pc2)){
+			fprintf(stderr,"Bad deduplicated list set\n");
+			return -1;
+		}
+		pkgset_free(ps);
+	}
+	free_package_cache(pc1);
+	free_package_cache(pc2);
+	remove_listdir(dir1);
+	remove_listdir(dir2);
+	return 0;
+}
+
+static int
+write_buf(const char *path,const void *buf,size_t len){
+	FILE *fp;
+	int r;
+
+	if((fp = fopen(path,"w")) == NULL){
+		return -1;
+	}
+	r = len && fwrite(buf,len,1,fp) != 1;
+	return fclose(fp) || r ? -1 : 0;
+}
+
+static int
+write_file(const char *dir,const char *name,const char *contents){
+	char path[PATH_MAX];
+
+	snprintf(path,sizeof(path),"%s/%s",dir,name);
+	return write_buf(path,contents,strlen(contents));
+}
+
+// FNV-1a over the package's name and version.
+static unsigned long long
+pkg_hash(const struct pkgobj *po){
+	unsigned long long h = 14695981039346656037ull;
+	const char *s;
+	size_t len;
+
+	for(s = pkgobj_nameview(po,&len) ; len-- ; ++s){
+		h = (h ^ (unsigned char)*s) * 1099511628211ull;
+	}
+	h = (h ^ ' ') * 1099511628211ull;
+	for(s = pkgobj_versionview(po,&len) ; s && len-- ; ++s){
+		h = (h ^ (unsigned char)*s) * 1099511628211ull;
+	}
+	return h;
+}
+
+// An order-independent digest of a list's (name, version) pairs.
+static unsigned long long
+list_digest(const struct pkglist *pl){
+	unsigned long long digest = 0;
+	const struct pkgobj *po;
+
+	for(po = pkglist_begin(pl) ; po ; po = pkglist_next(po)){
+		digest += pkg_hash(po);
+	}
+	return digest;
+}
+
+// An order-independent digest of the packages matched to the anchors, whose
+// number is written through.
+static unsigned long long
+match_digest(const struct pkglist *anchors,unsigned *matches){
+	unsigned long long digest = 0;
+	const struct pkgobj *po,*m;
+
+	*matches = 0;
+	for(po = pkglist_begin(anchors) ; po ; po = pkglist_next(po)){
+		for(m = pkgobj_matchbegin(po) ; m ; m = pkgobj_matchnext(m)){
+			digest += pkg_hash(po) * 31 + pkg_hash(m);
+			++*matches;
+		}
+	}
+	return digest;
+}
+
+// Every list of the cache must hold the packages of the base cache's sole
+// list, and their distributions must be exactly those specified.
+static int
+same_lists(const struct pkgcache *pc,const struct pkgcache *base,
+		const char * const *dists,const char *what){
+	unsigned long long digest = list_digest(pkgcache_begin(base));
+	const struct pkglist *pl;
+	unsigned lists = 0,z;
+
+	for(pl = pkgcache_begin(pc) ; pl ; pl = pkgcache_next(pl)){
+		for(z = 0 ; dists[z] ; ++z){
+			if(strcmp(pkglist_dist(pl),dists[z]) == 0){
+				break;
+			}
+		}
+		if(dists[z] == NULL || strcmp(pkglist_component(pl),"main") ||
+				strcmp(pkglist_arch(pl),"amd64") || list_digest(pl) != digest){
+			fprintf(stderr,"Bad %s list (%s)\n",what,pkglist_dist(pl));
+			return -1;
+		}
+		++lists;
+	}
+	for(z = 0 ; dists[z] ; ++z){
+		;
+	}
+	if(lists != z || pkgcache_count(pc) != z * pkgcache_count(base)){
+		fprintf(stderr,"Bad %s lists (%u of %u)\n",what,lists,z);
+		return -1;
+	}
+	return 0;
+}
+
+// The base cache: the list alone, lexed from a directory the plain way.
+static struct pkgcache *
+base_cache(const char *path,char **dir){
+	const char * const one[] = { "one", NULL };
+	struct pkgcache *pc;
+	int err;
+
+	if((*dir = make_listdir(path,one)) == NULL){
+		return NULL;
+	}
+	if((pc = lex_packages_dir(*dir,&err,NULL)) == NULL){
+		fprintf(stderr,"Couldn't lex %s (%s?)\n",*dir,strerror(err));
+	}
+	return pc;
+}
+
+// Release files name the lists of their distributions (those of an
+// InRelease's signature don't count), and a sources.list names live
+// distributions; lists named by neither are skipped.
+static int
+check_discovery(const char *path,const struct pkgcache *base){
+	const char * const all[] = { "one", "two", "three", NULL };
+	const char * const released[] = { "one", "three", NULL };
+	const char * const sourced[] = { "one", NULL };
+	char srcpath[PATH_MAX];
+	raptorial_lexopts opts = { .flags = 0, };
+	struct pkgcache *pc;
+	char *dir;
+	int err;
+
+	if((dir = make_listdir(path,all)) == NULL){
+		return -1;
+	}
+	snprintf(srcpath,sizeof(srcpath),"%s/sources.list",dir);
+	if(write_file(dir,"example.org_debian_dists_one_Release",
+				"Suite: one\nSHA256:\n 0123 100 main/binary-amd64/Packages\n") ||
+			write_file(dir,"example.org_debian_dists_two_InRelease",
+				"-----BEGIN PGP SIGNED MESSAGE-----\nHash: SHA256\n\n"
+				"Suite: two\nSHA256:\n 0123 100 contrib/binary-amd64/Packages\n"
+				"-----BEGIN PGP SIGNATURE-----\n 0123 100 main/binary-amd64/Packages\n"
+				"-----END PGP SIGNATURE-----\n") ||
+			write_file(dir,"sources.list","deb http://example.org/debian one main\n")){
+		fprintf(stderr,"Couldn't write to %s (%s?)\n",dir,strerror(errno));
+		return -1;
+	}
+	if((pc = lex_packages_dir_opts(dir,&err,NULL,&opts)) == NULL){
+		fprintf(stderr,"Couldn't lex %s (%s?)\n",dir,strerror(err));
+		return -1;
+	}
+	if(same_lists(pc,base,released,"released")){
+		return -1;
+	}
+	free_package_cache(pc);
+	opts.sources = srcpath;
+	if((pc = lex_packages_dir_opts(dir,&err,NULL,&opts)) == NULL){
+		fprintf(stderr,"Couldn't lex %s (%s?)\n",dir,strerror(err));
+		return -1;
+	}
+	if(same_lists(pc,base,sourced,"sourced")){
+		return -1;
+	}
+	free_package_cache(pc);
+	remove_listdir(dir);
+	return 0;
+}
+
+// A refresh lexes added lists and drops removed ones, renumbering the rest,
+// and reindexes the cache.
+static int
+check_refresh(const char *path,const struct pkgcache *base){
+	const char * const one[] = { "one", NULL };
+	const char * const both[] = { "one", "two", NULL };
+	const char * const two[] = { "two", NULL };
+	const raptorial_lexopts opts = { .flags = RAPTORIAL_LEX_INDEX, };
+	const struct pkgobj * const *found;
+	const char *probe = NULL;
+	char name[PATH_MAX];
+	struct pkgcache *pc;
+	struct pkgset *ps;
+	unsigned names;
+	char *dir;
+	int err;
+
+	if((dir = make_listdir(path,one)) == NULL){
+		return -1;
+	}
+	if((pc = lex_packages_dir_opts(dir,&err,NULL,&opts)) == NULL){
+		fprintf(stderr,"Couldn't lex %s (%s?)\n",dir,strerror(err));
+		return -1;
+	}
+	names = pkgcache_names(pc);
+	if(pkglist_begin(pkgcache_begin(base))){
+		probe = pkgobj_name(pkglist_begin(pkgcache_begin(base)));
+	}
+	if(link_list(dir,path,"two") || pkgcache_refresh(pc,dir,&err)){
+		fprintf(stderr,"Couldn't refresh %s (%s?)\n",dir,strerror(err));
+		return -1;
+	}
+	if(same_lists(pc,base,both,"added") || pkgcache_names(pc) != names ||
+			(probe && pkgcache_lookup(pc,probe,&found) < 2)){
+		fprintf(stderr,"Bad refresh with added list\n");
+		return -1;
+	}
+	list_name(name,sizeof(name),dir,path,"one");
+	if(unlink(name) || pkgcache_refresh(pc,dir,&err)){
+		fprintf(stderr,"Couldn't refresh %s (%s?)\n",dir,strerror(err));
+		return -1;
+	}
+	if(same_lists(pc,base,two,"renumbered") || pkgcache_names(pc) != names){
+		fprintf(stderr,"Bad refresh with dropped list\n");
+		return -1;
+	}
+	if((ps = pkgset_from_list(pc,pkgcache_begin(pc),&err)) == NULL ||
+			pkgset_count(ps) != names){
+		fprintf(stderr,"Bad refreshed list set\n");
+		return -1;
+	}
+	pkgset_free(ps);
+	free_package_cache(pc);
+	remove_listdir(dir);
+	return 0;
+}
+
+// Lexing under a memory budget, however tight, must produce the same cache,
+// and the budget can't be combined with views into the mapped lists.
+static int
+check_membudget(const char *path,const struct pkgcache *base){
+	const char * const both[] = { "one", "two", NULL };
+	const size_t budgets[] = { 1, 1ul << 40, };
+	const unsigned incompat[] = { RAPTORIAL_LEX_ZEROCOPY, RAPTORIAL_LEX_FIELDS, };
+	struct pkgcache *pc;
+	unsigned z;
+	char *dir;
+	int err;
+
+	if((dir = make_listdir(path,both)) == NULL){
+		return -1;
+	}
+	for(z = 0 ; z < sizeof(budgets) / sizeof(*budgets) ; ++z){
+		const raptorial_lexopts opts = { .membudget = budgets[z], };
+
+		if((pc = lex_packages_dir_opts(dir,&err,NULL,&opts)) == NULL){
+			fprintf(stderr,"Couldn't lex %s in %zu bytes (%s?)\n",dir,budgets[z],strerror(err));
+			return -1;
+		}
+		if(same_lists(pc,base,both,"budgeted")){
+			return -1;
+		}
+		free_package_cache(pc);
+	}
+	for(z = 0 ; z < sizeof(incompat) / sizeof(*incompat) ; ++z){
+		raptorial_lexopts opts = { .flags = incompat[z], };
+
+		if((pc = lex_packages_dir_opts(dir,&err,NULL,&opts)) == NULL){
+			fprintf(stderr,"Couldn't lex %s with flags %u (%s?)\n",dir,incompat[z],strerror(err));
+			return -1;
+		}
+		free_package_cache(pc);
+		opts.membudget = 1;
+		err = 0;
+		if((pc = lex_packages_dir_opts(dir,&err,NULL,&opts)) || err != EINVAL){
+			fprintf(stderr,"Accepted a budget with flags %u\n",incompat[z]);
+			return -1;
+		}
+	}
+	remove_listdir(dir);
+	return 0;
+}
+
+// A list of numbered packages, large enough to span several chunks.
+static char *
+make_list(unsigned pkgs,size_t *len){
+	const size_t stanza = 128;
+	char *list;
+	unsigned z;
+
+	if((list = malloc(stanza * pkgs + 1)) == NULL){
+		return NULL;
+	}
+	*len = 0;
+	for(z = 0 ; z < pkgs ; ++z){
+		*len += snprintf(list + *len,stanza,"Package: pkg%u\nVersion: 1.%u-%u\n"
+				"Architecture: amd64\nDescription: package %u\n\n",z,z,z % 7,z);
+	}
+	return list;
+}
+
+// Each compressor returns a heap-allocated image of the buffer, writing its
+// length through, or NULL on failure.
+static void *
+gzip_buf(const void *in,size_t inlen,size_t *outlen){
+	z_stream z;
+	void *out;
+
+	memset(&z,0,sizeof(z));
+	if(deflateInit2(&z,Z_DEFAULT_COMPRESSION,Z_DEFLATED,15 + 16,8,Z_DEFAULT_STRATEGY) != Z_OK){
+		return NULL;
+	}
+	*outlen = deflateBound(&z,inlen);
+	if((out = malloc(*outlen)) == NULL){
+		deflateEnd(&z);
+		return NULL;
+	}
+	z.next_in = (void *)in;
+	z.avail_in = inlen;
+	z.next_out = out;
+	z.avail_out = *outlen;
+	if(deflate(&z,Z_FINISH) != Z_STREAM_END){
+		deflateEnd(&z);
+		free(out);
+		return NULL;
+	}
+	*outlen = z.total_out;
+	deflateEnd(&z);
+	return out;
+}
+
+#ifdef HAVE_LZMA
+static void *
+xz_buf(const void *in,size_t inlen,size_t *outlen){
+	size_t bound = lzma_stream_buffer_bound(inlen);
+	void *out;
+
+	if((out = malloc(bound)) == NULL){
+		return NULL;
+	}
+	*outlen = 0;
+	if(lzma_easy_buffer_encode(1,LZMA_CHECK_CRC64,NULL,in,inlen,out,outlen,bound) != LZMA_OK){
+		free(out);
+		return NULL;
+	}
+	return out;
+}
+#endif
+
+#ifdef HAVE_LZ4
+static void *
+lz4_buf(const void *in,size_t inlen,size_t *outlen){
+	size_t bound = LZ4F_compressFrameBound(inlen,NULL);
+	void *out;
+
+	if((out = malloc(bound)) == NULL){
+		return NULL;
+	}
+	*outlen = LZ4F_compressFrame(out,bound,in,inlen,NULL);
+	if(LZ4F_isError(*outlen)){
+		free(out);
+		return NULL;
+	}
+	return out;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static void *
+zstd_buf(const void *in,size_t inlen,size_t *outlen){
+	size_t bound = ZSTD_compressBound(inlen);
+	void *out;
+
+	if((out = malloc(bound)) == NULL){
+		return NULL;
+	}
+	*outlen = ZSTD_compress(out,bound,in,inlen,3);
+	if(ZSTD_isError(*outlen)){
+		free(out);
+		return NULL;
+	}
+	return out;
+}
+#endif
+
+static const struct {
+	const char *dist; // also the suffix, following a '.'
+	void *(*compress)(const void *,size_t,size_t *);
+} compressors[] = {
+	{ "gz", gzip_buf, },
+#ifdef HAVE_LZMA
+	{ "xz", xz_buf, },
+#endif
+#ifdef HAVE_LZ4
+	{ "lz4", lz4_buf, },
+#endif
+#ifdef HAVE_ZSTD
+	{ "zst", zstd_buf, },
+#endif
+	{ NULL, NULL, },
+};
+
+// Write the list into the directory as the distribution named for the
+// compressor, compressed by it, and truncated to half its length if
+// requested. The terminating entry writes it plain, as "plain".
+static int
+write_list(const char *dir,const char *list,size_t len,unsigned comp,int truncate){
+	const char *dist = compressors[comp].dist ? compressors[comp].dist : "plain";
+	char name[PATH_MAX],path[16];
+	void *out = NULL;
+	size_t outlen;
+	int r;
+
+	snprintf(path,sizeof(path),"Packages.%s",dist);
+	list_name(name,sizeof(name),dir,path,dist);
+	if(compressors[comp].compress){
+		if((out = compressors[comp].compress(list,len,&outlen)) == NULL){
+			fprintf(stderr,"Couldn't compress with %s\n",dist);
+			return -1;
+		}
+		list = out;
+		len = outlen;
+	}
+	if(truncate){
+		len /= 2;
+	}
+	if( (r = write_buf(name,list,len)) ){
+		fprintf(stderr,"Couldn't write %s (%s?)\n",name,strerror(errno));
+	}
+	free(out);
+	return r;
+}
+
+// Each compressed form of a list must yield its packages, whether lexed
+// alone or from a directory, and a truncated one must fail with EINVAL
+// rather than yield a partial list.
+static int
+check_compressed(void){
+	const char * const none[] = { NULL };
+	const char *dists[sizeof(compressors) / sizeof(*compressors)];
+	char name[PATH_MAX],path[16];
+	const unsigned pkgs = 5000;
+	struct pkgcache *base,*pc;
+	char *dir,*tdir,*list;
+	struct pkglist *pl;
+	unsigned comp;
+	size_t len;
+	int err;
+
+	if((list = make_list(pkgs,&len)) == NULL){
+		return -1;
+	}
+	if((dir = make_listdir(NULL,none)) == NULL || write_list(dir,list,len,
+				sizeof(compressors) / sizeof(*compressors) - 1,0)){
+		return -1;
+	}
+	if((base = lex_packages_dir(dir,&err,NULL)) == NULL){
+		fprintf(stderr,"Couldn't lex %s (%s?)\n",dir,strerror(err));
+		return -1;
+	}
+	if(pkgcache_count(base) != pkgs){
+		fprintf(stderr,"Generated package count was inaccurate (%u != %u)\n",
+				pkgcache_count(base),pkgs);
+		return -1;
+	}
+	remove_listdir(dir);
+	if((dir = make_listdir(NULL,none)) == NULL || (tdir = make_listdir(NULL,none)) == NULL){
+		return -1;
+	}
+	for(comp = 0 ; compressors[comp].dist ; ++comp){
+		dists[comp] = compressors[comp].dist;
+		if(write_list(dir,list,len,comp,0) || write_list(tdir,list,len,comp,1)){
+			return -1;
+		}
+		snprintf(path,sizeof(path),"Packages.%s",dists[comp]);
+		list_name(name,sizeof(name),dir,path,dists[comp]);
+		if((pl = lex_packages_file(name,&err,NULL)) == NULL){
+			fprintf(stderr,"Couldn't lex %s (%s?)\n",name,strerror(err));
+			return -1;
+		}
+		if(list_digest(pl) != list_digest(pkgcache_begin(base))){
+			fprintf(stderr,"Bad decompressed list %s\n",name);
+			return -1;
+		}
+		free_package_list(pl);
+		list_name(name,sizeof(name),tdir,path,dists[comp]);
+		err = 0;
+		if((pl = lex_packages_file(name,&err,NULL)) || err != EINVAL){
+			fprintf(stderr,"Accepted truncated %s (%s?)\n",name,strerror(err));
+			return -1;
+		}
+	}
+	dists[comp] = NULL;
+	if((pc = lex_packages_dir(dir,&err,NULL)) == NULL){
+		fprintf(stderr,"Couldn't lex %s (%s?)\n",dir,strerror(err));
+		return -1;
+	}
+	if(same_lists(pc,base,dists,"decompressed")){
+		return -1;
+	}
+	free_package_cache(pc);
+	// However tight the budget, each is admitted, alone if need be
+	const raptorial_lexopts opts = { .membudget = 1, };
+
+	if((pc = lex_packages_dir_opts(dir,&err,NULL,&opts)) == NULL){
+		fprintf(stderr,"Couldn't lex %s in budget (%s?)\n",dir,strerror(err));
+		return -1;
+	}
+	if(same_lists(pc,base,dists,"budgeted decompressed")){
+		return -1;
+	}
+	free_package_cache(pc);
+	err = 0;
+	if((pc = lex_packages_dir(tdir,&err,NULL)) || err != EINVAL){
+		fprintf(stderr,"Accepted truncated lists in %s (%s?)\n",tdir,strerror(err));
+		return -1;
+	}
+	free_package_cache(base);
+	remove_listdir(dir);
+	remove_listdir(tdir);
+	free(list);
+	return 0;
+}
+
+// Ids which are multiples of mod, and less than below.
+struct idfilter {
+	unsigned mod,below;
+};
+
+static int
+in_filter(const struct idfilter *f,unsigned id){
+	return id % f->mod == 0 && id < f->below;
+}
+
+static int
+id_filter(const struct pkgobj *po,void *vf){
+	return in_filter(vf,pkgobj_nameid(po));
+}
+
+// The set must hold exactly the ids which the operation (0 for intersection,
+// 1 for union, 2 for difference) admits from the two filters.
+static int
+check_set(const struct pkgset *ps,unsigned names,const struct idfilter *a,
+		const struct idfilter *b,int op){
+	unsigned id,members = 0,next = 0;
+	int in;
+
+	for(id = 0 ; id < names ; ++id){
+		in = op == 0 ? in_filter(a,id) && in_filter(b,id) :
+			op == 1 ? in_filter(a,id) || in_filter(b,id) :
+			in_filter(a,id) && !in_filter(b,id);
+		if(!in != !pkgset_contains(ps,id)){
+			fprintf(stderr,"Bad membership of %u in set (op %d)\n",id,op);
+			return -1;
+		}
+		if(in){
+			if(!pkgset_next(ps,&next) || next != id){
+				fprintf(stderr,"Bad iteration to %u in set (op %d)\n",id,op);
+				return -1;
+			}
+			++next;
+			++members;
+		}
+	}
+	if(pkgset_next(ps,&next) || pkgset_count(ps) != members){
+		fprintf(stderr,"Bad set count (%zu != %u, op %d)\n",pkgset_count(ps),members,op);
+		return -1;
+	}
+	return 0;
+}
+
+// Set operations over a single container of ids, converting between its
+// sparse (array) and dense (bitmap) forms in both directions.
+static int
+check_pkgsets(void){
+	const unsigned pkgs = 12000;
+	const raptorial_lexopts opts = { .flags = RAPTORIAL_LEX_INDEX, };
+	const struct idfilter filters[] = {
+		{ 2, UINT_MAX, }, // 6000 members: dense
+		{ 3, UINT_MAX, }, // 4000: sparse
+		{ 1, 3000, },     // 3000: sparse
+	};
+	const unsigned nfilters = sizeof(filters) / sizeof(*filters);
+	struct pkgset *sets[sizeof(filters) / sizeof(*filters)],*ps;
+	const char * const none[] = { NULL };
+	struct pkgcache *pc;
+	unsigned a,b,z;
+	size_t len;
+	char *dir,*list;
+	int err,op;
+
+	if((list = make_list(pkgs,&len)) == NULL || (dir = make_listdir(NULL,none)) == NULL ||
+			write_list(dir,list,len,sizeof(compressors) / sizeof(*compressors) - 1,0)){
+		return -1;
+	}
+	free(list);
+	// Without an index, no id names a package
+	if((pc = lex_packages_dir(dir,&err,NULL)) == NULL){
+		fprintf(stderr,"Couldn't lex %s (%s?)\n",dir,strerror(err));
+		return -1;
+	}
+	if(pkgcache_names(pc) || pkgcache_idname(pc,0,&len)){
+		fprintf(stderr,"Unindexed cache named an id\n");
+		return -1;
+	}
+	free_package_cache(pc);
+	if((pc = lex_packages_dir_opts(dir,&err,NULL,&opts)) == NULL){
+		fprintf(stderr,"Couldn't lex %s (%s?)\n",dir,strerror(err));
+		return -1;
+	}
+	remove_listdir(dir);
+	if(pkgcache_names(pc) != pkgs || pkgcache_idname(pc,pkgs,&len)){
+		fprintf(stderr,"Bad name ids (%u != %u)\n",pkgcache_names(pc),pkgs);
+		return -1;
+	}
+	for(z = 0 ; z < nfilters ; ++z){
+		if((sets[z] = pkgset_from_pkgobjs(pc,id_filter,(void *)&filters[z],&err)) == NULL){
+			fprintf(stderr,"Couldn't build package set (%s?)\n",strerror(err));
+			return -1;
+		}
+	}
+	// Every ordered pair, so each form meets each other on both sides
+	for(a = 0 ; a < nfilters ; ++a){
+		for(b = 0 ; b < nfilters ; ++b){
+			for(op = 0 ; op < 3 ; ++op){
+				ps = op == 0 ? pkgset_intersect(sets[a],sets[b],&err) :
+					op == 1 ? pkgset_union(sets[a],sets[b],&err) :
+					pkgset_difference(sets[a],sets[b],&err);
+				if(ps == NULL){
+					fprintf(stderr,"Couldn't combine package sets (%s?)\n",strerror(err));
+					return -1;
+				}
+				if(check_set(ps,pkgs,&filters[a],&filters[b],op)){
+					return -1;
+				}
+				pkgset_free(ps);
+			}
+		}
+	}
+	for(z = 0 ; z < nfilters ; ++z){
+		pkgset_free(sets[z]);
+	}
+	free_package_cache(pc);
+	return 0;
+}
+
+// Each way of reading lists must find the same packages, whether lexing a
+// single file or a directory.
+static int
+check_io(const char *path,const struct pkgcache *base){
+	const raptorial_io ios[] = {
+		RAPTORIAL_IO_POPULATE, RAPTORIAL_IO_LAZY,
+		RAPTORIAL_IO_HUGEPAGE, RAPTORIAL_IO_PREAD,
+	};
+	const char * const both[] = { "one", "two", NULL };
+	struct pkgcache *pc;
+	struct pkglist *pl;
+	unsigned z;
+	char *dir;
+	int err;
+
+	if((dir = make_listdir(path,both)) == NULL){
+		return -1;
+	}
+	for(z = 0 ; z < sizeof(ios) / sizeof(*ios) ; ++z){
+		const raptorial_lexopts opts = { .io = ios[z], };
+
+		if((pl = lex_packages_file_opts(path,&err,NULL,&opts)) == NULL){
+			fprintf(stderr,"Couldn't lex %s with I/O %d (%s?)\n",path,ios[z],strerror(err));
+			return -1;
+		}
+		if(list_digest(pl) != list_digest(pkgcache_begin(base))){
+			fprintf(stderr,"Bad list with I/O %d\n",ios[z]);
+			return -1;
+		}
+		free_package_list(pl);
+		if((pc = lex_packages_dir_opts(dir,&err,NULL,&opts)) == NULL){
+			fprintf(stderr,"Couldn't lex %s with I/O %d (%s?)\n",dir,ios[z],strerror(err));
+			return -1;
+		}
+		if(same_lists(pc,base,both,"I/O strategy")){
+			return -1;
+		}
+		free_package_cache(pc);
+	}
+	remove_listdir(dir);
+	return 0;
+}
+
+// Can we set up an io_uring as the library would? If not, it falls back to
+// reading lists with pread().
+static int
+uring_usable(void){
+#ifdef HAVE_IO_URING
+	struct io_uring_params p;
+	int fd;
+
+	memset(&p,0,sizeof(p));
+	if((fd = syscall(__NR_io_uring_setup,1,&p)) >= 0){
+		close(fd);
+		return (p.features & IORING_FEAT_RW_CUR_POS) != 0;
+	}
+#endif
+	return 0;
+}
+
+// The packages of a cache (or NULL), summed over its lists.
+static unsigned long long
+cache_digest(const struct pkgcache *pc){
+	unsigned long long digest = 0;
+	const struct pkglist *pl;
+
+	for(pl = pc ? pkgcache_begin(pc) : NULL ; pl ; pl = pkgcache_next(pl)){
+		digest += list_digest(pl);
+	}
+	return digest;
+}
+
+// Reading a directory's lists through io_uring must find what mapping them
+// does. An empty list fails its read, and must then be handled as it is
+// without io_uring.
+static int
+check_uring(const char *path,const struct pkgcache *base){
+	const char * const three[] = { "one", "two", "three", NULL };
+	raptorial_lexopts opts = { .io = RAPTORIAL_IO_URING, };
+	struct pkgcache *pc,*mpc;
+	char name[PATH_MAX];
+	int err,merr;
+	char *dir;
+
+	if(!uring_usable()){
+		fprintf(stderr,"io_uring is unavailable; skipping its test\n");
+		return 0;
+	}
+	if((dir = make_listdir(path,three)) == NULL){
+		return -1;
+	}
+	if((pc = lex_packages_dir_opts(dir,&err,NULL,&opts)) == NULL){
+		fprintf(stderr,"Couldn't lex %s through io_uring (%s?)\n",dir,strerror(err));
+		return -1;
+	}
+	if(same_lists(pc,base,three,"io_uring")){
+		return -1;
+	}
+	free_package_cache(pc);
+	list_name(name,sizeof(name),dir,"Packages","empty");
+	if(write_buf(name,"",0)){
+		fprintf(stderr,"Couldn't write %s (%s?)\n",name,strerror(errno));
+		return -1;
+	}
+	err = merr = 0;
+	pc = lex_packages_dir_opts(dir,&err,NULL,&opts);
+	mpc = lex_packages_dir(dir,&merr,NULL);
+	if(!pc != !mpc || (pc == NULL && err != merr) ||
+			(pc && pkgcache_count(pc) != pkgcache_count(mpc)) ||
+			cache_digest(pc) != cache_digest(mpc)){
+		fprintf(stderr,"Bad io_uring lex with an empty list (%s/%s)\n",
+				strerror(err),strerror(merr));
+		return -1;
+	}
+	free_package_cache(pc);
+	free_package_cache(mpc);
+	remove_listdir(dir);
+	return 0;
+}
+
+// Lex the list into a fresh dfa, as rapt-show-versions does the status file.
+static struct pkglist *
+anchor_list(const char *path,struct dfa **dfa){
+	struct pkglist *pl;
+	int err;
+
+	*dfa = NULL;
+	if((pl = lex_packages_file(path,&err,dfa)) == NULL){
+		fprintf(stderr,"Couldn't parse %s (%s?)\n",path,strerror(err));
+	}
+	return pl;
+}
+
+// Lexing lists unfiltered and attaching them to the dfa afterwards (as when
+// pipelining) must match the same packages as filtering them while lexing.
+static int
+check_attach(const char *path){
+	const char * const both[] = { "one", "two", NULL };
+	unsigned long long digest;
+	struct pkglist *anchors;
+	struct pkgcache *pc;
+	unsigned matches,m,z;
+	struct dfa *dfa;
+	char *dir;
+	int err;
+
+	if((dir = make_listdir(path,both)) == NULL || (anchors = anchor_list(path,&dfa)) == NULL){
+		return -1;
+	}
+	if((pc = lex_packages_dir(dir,&err,dfa)) == NULL){
+		fprintf(stderr,"Couldn't lex %s (%s?)\n",dir,strerror(err));
+		return -1;
+	}
+	digest = match_digest(anchors,&matches);
+	if(matches != pkgcache_count(pc) || matches == 0){
+		fprintf(stderr,"Bad filtered matches (%u)\n",matches);
+		return -1;
+	}
+	free_package_cache(pc);
+	free_package_list(anchors); // the dfa's matches go with its anchors
+	free_dfa(dfa);
+	// Attach both with and without a name index
+	for(z = 0 ; z < 2 ; ++z){
+		const raptorial_lexopts opts = {
+			.flags = z ? RAPTORIAL_LEX_INDEX : 0,
+		};
+
+		if((anchors = anchor_list(path,&dfa)) == NULL){
+			return -1;
+		}
+		if((pc = lex_packages_dir_opts(dir,&err,NULL,&opts)) == NULL ||
+				pkgcache_attach(pc,dfa,&err)){
+			fprintf(stderr,"Couldn't lex and attach %s (%s?)\n",dir,strerror(err));
+			return -1;
+		}
+		if(match_digest(anchors,&m) != digest || m != matches){
+			fprintf(stderr,"Bad attached matches (%u != %u)\n",m,matches);
+			return -1;
+		}
+		if(pkgcache_attach(pc,dfa,&err) == 0 || err != EINVAL){
+			fprintf(stderr,"Attached a cache twice\n");
+			return -1;
+		}
+		free_package_cache(pc);
+		free_package_list(anchors);
+		free_dfa(dfa);
+	}
+	remove_listdir(dir);
+	return 0;
+}
+
+// Lex the list as written into a pipe by a child, a few KB at a time.
+static struct pkglist *
+pipe_list(const char *path,const raptorial_lexopts *opts,int *err){
+	struct pkglist *pl;
+	int fds[2],status;
+	pid_t pid;
+
+	if(pipe(fds)){
+		*err = errno;
+		return NULL;
+	}
+	if((pid = fork()) < 0){
+		*err = errno;
+		close(fds[0]);
+		close(fds[1]);
+		return NULL;
+	}else if(pid == 0){
+		char buf[4093];
+		ssize_t r;
+		int fd;
+
+		close(fds[0]);
+		if((fd = open(path,O_RDONLY)) < 0){
+			_exit(EXIT_FAILURE);
+		}
+		while((r = read(fd,buf,sizeof(buf))) > 0){
+			if(write(fds[1],buf,r) != r){
+				_exit(EXIT_FAILURE);
+			}
+		}
+		_exit(r ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	close(fds[1]);
+	pl = opts ? lex_packages_fd_opts(fds[0],err,NULL,opts) :
+		lex_packages_fd(fds[0],err,NULL);
+	close(fds[0]);
+	if(waitpid(pid,&status,0) != pid || !WIFEXITED(status) || WEXITSTATUS(status)){
+		if(pl){
+			*err = EIO;
+			free_package_list(pl);
+		}
+		return NULL;
+	}
+	return pl;
+}
+
+// Count the stanza against its worker, after checking its views.
+static int
+count_stanza(const raptorial_stanza *st,void *vcounts){
+	unsigned *counts = vcounts;
+
+	if(st->package.val == NULL || st->package.len == 0 ||
+			st->text.val != st->package.val - strlen("Package: ") ||
+			st->fields[0].val == NULL || st->worker >= raptorial_workers()){
+		return EINVAL;
+	}
+	++counts[st->worker];
+	return 0;
+}
+
 int main(int argc,char **argv){
 	const struct pkglist *pl;
 	const struct pkgobj *po;
+	const struct pkgobj * const *index;
 	struct pkgcache *pc;
 	struct dfa *dfa;
 	unsigned pkgs;
@@ -66,6 +1103,235 @@ int main(int argc,char **argv){
 	free_package_cache(pc);
 	free_dfa(dfa);
 
+	// Zero-copy lexing must find the same packages, all of them views,
+	// and each must be found in the name index
+	const char * const zcfields[] = { "Architecture", NULL };
+	const raptorial_lexopts zcopts = {
+		.flags = RAPTORIAL_LEX_ZEROCOPY | RAPTORIAL_LEX_INDEX,
+		.fields = zcfields,
+	};
+	if((pc = pkgcache_from_pkglist(lex_packages_file_opts(argv[1],&err,NULL,&zcopts),&err)) == NULL){
+		fprintf(stderr,"Couldn't parse %s (%s?)\n",argv[1],strerror(err));
+		return EXIT_FAILURE;
+	}
+	pkgs = 0;
+	for(pl = pkgcache_begin(pc) ; pl ; pl = pkgcache_next(pl)){
+		for(po = pkglist_begin(pl) ; po ; po = pkglist_next(po)){
+			const char *name,*ver;
+			size_t nlen,vlen,flen;
+
+			name = pkgobj_nameview(po,&nlen);
+			ver = pkgobj_versionview(po,&vlen);
+			if(pkgobj_name(po) || nlen == 0 || vlen == 0){
+				fprintf(stderr,"Bad zero-copy view (%.*s)\n",(int)nlen,name);
+				return EXIT_FAILURE;
+			}
+			printf("%.*s %.*s\n",(int)nlen,name,(int)vlen,ver);
+			// Fields parsed on demand must agree with the lexer
+			if(pkgobj_field(po,"package",&flen) != name || flen != nlen ||
+					pkgobj_field(po,"Version",&flen) != ver || flen != vlen){
+				fprintf(stderr,"Bad field lookup (%.*s)\n",(int)nlen,name);
+				return EXIT_FAILURE;
+			}
+			if(pkgobj_captured(po,0,&flen) == NULL ||
+					pkgobj_captured(po,0,&flen) != pkgobj_field(po,"architecture",&flen)){
+				fprintf(stderr,"Bad captured field (%.*s)\n",(int)nlen,name);
+				return EXIT_FAILURE;
+			}
+			char cname[nlen + 1];
+			const struct pkgobj * const *found;
+			size_t nfound;
+
+			memcpy(cname,name,nlen);
+			cname[nlen] = '\0';
+			nfound = pkgcache_lookup(pc,cname,&found);
+			while(nfound && found[nfound - 1] != po){
+				--nfound;
+			}
+			if(nfound == 0){
+				fprintf(stderr,"Couldn't look up %s\n",cname);
+				return EXIT_FAILURE;
+			}
+			if(pkgobj_nameid(po) != pkgcache_nameid(pc,cname) ||
+					pkgcache_idname(pc,pkgobj_nameid(po),&flen) != pkgobj_nameview(found[0],&flen)){
+				fprintf(stderr,"Bad name id (%s)\n",cname);
+				return EXIT_FAILURE;
+			}
+			++pkgs;
+		}
+	}
+	if(pkgs != pkgcache_count(pc)){
+		fprintf(stderr,"Package count was inaccurate (%u != %u)\n",
+				pkgs,pkgcache_count(pc));
+		return EXIT_FAILURE;
+	}
+	if(pkgcache_prefix(pc,"",&index) != pkgs || pkgcache_range(pc,"",NULL,&index) != pkgs){
+		fprintf(stderr,"Name index was incomplete\n");
+		return EXIT_FAILURE;
+	}
+	// Set algebra over the list's names
+	struct pkgset *names,*both,*neither;
+
+	if((names = pkgset_from_list(pc,pkgcache_begin(pc),&err)) == NULL ||
+			(both = pkgset_union(names,names,&err)) == NULL ||
+			(neither = pkgset_difference(both,names,&err)) == NULL){
+		fprintf(stderr,"Couldn't build package sets (%s?)\n",strerror(err));
+		return EXIT_FAILURE;
+	}
+	if(pkgset_count(names) != pkgcache_names(pc) ||
+			pkgset_count(both) != pkgcache_names(pc) || pkgset_count(neither)){
+		fprintf(stderr,"Bad package set\n");
+		return EXIT_FAILURE;
+	}
+	pkgset_free(neither);
+	pkgset_free(both);
+	pkgset_free(names);
+	// A list which isn't the cache's own is rejected
+	struct pkglist *foreign;
+
+	if((foreign = lex_packages_file(argv[1],&err,NULL)) == NULL){
+		fprintf(stderr,"Couldn't parse %s (%s?)\n",argv[1],strerror(err));
+		return EXIT_FAILURE;
+	}
+	err = 0;
+	if(pkgset_from_list(pc,foreign,&err) || err != EINVAL){
+		fprintf(stderr,"Accepted a foreign list\n");
+		return EXIT_FAILURE;
+	}
+	free_package_list(foreign);
+
+	// Columnar lexing must find the same packages, each in the name index
+	const raptorial_lexopts colopts = {
+		.flags = RAPTORIAL_LEX_COLUMNAR,
+	};
+	const struct pkgtable *pt;
+	struct pkgcache *colpc;
+	unsigned row;
+
+	if((colpc = pkgcache_from_pkglist(lex_packages_file_opts(argv[1],&err,NULL,&colopts),&err)) == NULL){
+		fprintf(stderr,"Couldn't parse %s (%s?)\n",argv[1],strerror(err));
+		return EXIT_FAILURE;
+	}
+	if((pt = pkgcache_table(colpc)) == NULL || pkgtable_rows(pt) != pkgs ||
+			pkgcache_count(colpc) != pkgs || pkgtable_nlists(pt) != 1 ||
+			pkgtable_list(pt,0) != pkgcache_begin(colpc)){
+		fprintf(stderr,"Bad columnar table\n");
+		return EXIT_FAILURE;
+	}
+	for(row = 0 ; row < pkgtable_rows(pt) ; ++row){
+		if(pkgtable_listids(pt)[row] != 0 || pkgtable_version(pt,row) == NULL ||
+				pkgcache_lookup(pc,pkgtable_name(pt,row),&index) == 0){
+			fprintf(stderr,"Bad columnar row (%s)\n",pkgtable_name(pt,row));
+			return EXIT_FAILURE;
+		}
+	}
+	// Streaming an uncompressed list through a pipe, in writes which split
+	// its stanzas, must find the same packages
+	if(!has_comp_suffix(argv[1])){
+		struct pkgcache *spc;
+
+		if((spc = pkgcache_from_pkglist(pipe_list(argv[1],NULL,&err),&err)) == NULL){
+			fprintf(stderr,"Couldn't stream %s (%s?)\n",argv[1],strerror(err));
+			return EXIT_FAILURE;
+		}
+		if(pkgcache_count(spc) != pkgs){
+			fprintf(stderr,"Streamed package count was inaccurate (%u != %u)\n",
+					pkgcache_count(spc),pkgs);
+			return EXIT_FAILURE;
+		}
+		free_package_cache(spc);
+	}
+	// The callback API must see every stanza, each with its package
+	unsigned *counts,cbpkgs = 0,w;
+
+	if((counts = calloc(raptorial_workers(),sizeof(*counts))) == NULL){
+		fprintf(stderr,"Couldn't allocate counters (%s?)\n",strerror(errno));
+		return EXIT_FAILURE;
+	}
+	if(lex_packages_file_cb(argv[1],zcfields,count_stanza,counts,&err)){
+		fprintf(stderr,"Couldn't walk %s (%s?)\n",argv[1],strerror(err));
+		return EXIT_FAILURE;
+	}
+	for(w = 0 ; w < raptorial_workers() ; ++w){
+		cbpkgs += counts[w];
+	}
+	free(counts);
+	if(cbpkgs != pkgs){
+		fprintf(stderr,"Callback package count was inaccurate (%u != %u)\n",
+				cbpkgs,pkgs);
+		return EXIT_FAILURE;
+	}
+	// A pool serves repeated lexes, indexing included
+	const raptorial_poolopts popts = { .threads = 2, };
+	raptorial_lexopts poolopts = { .flags = RAPTORIAL_LEX_INDEX, };
+	struct pkgcache *ppc;
+
+	if((poolopts.pool = raptorial_pool_create(&popts,&err)) == NULL){
+		fprintf(stderr,"Couldn't create pool (%s?)\n",strerror(err));
+		return EXIT_FAILURE;
+	}
+	for(w = 0 ; w < 2 ; ++w){
+		if((ppc = pkgcache_from_pkglist(lex_packages_file_opts(argv[1],&err,NULL,&poolopts),&err)) == NULL){
+			fprintf(stderr,"Couldn't parse %s on pool (%s?)\n",argv[1],strerror(err));
+			return EXIT_FAILURE;
+		}
+		if(pkgcache_count(ppc) != pkgs || (pkgs && pkgcache_lookup(ppc,
+				pkgtable_name(pt,0),&index) == 0)){
+			fprintf(stderr,"Bad pooled cache\n");
+			return EXIT_FAILURE;
+		}
+		free_package_cache(ppc);
+	}
+	// A pooled stream is read on the pool's workers
+	if(!has_comp_suffix(argv[1])){
+		if((ppc = pkgcache_from_pkglist(pipe_list(argv[1],&poolopts,&err),&err)) == NULL){
+			fprintf(stderr,"Couldn't stream %s on pool (%s?)\n",argv[1],strerror(err));
+			return EXIT_FAILURE;
+		}
+		if(pkgcache_count(ppc) != pkgs){
+			fprintf(stderr,"Pooled streamed package count was inaccurate (%u != %u)\n",
+					pkgcache_count(ppc),pkgs);
+			return EXIT_FAILURE;
+		}
+		free_package_cache(ppc);
+	}
+	raptorial_pool_free(poolopts.pool);
+	if(check_dedup(argv[1]) || check_compressed() || check_pkgsets()){
+		return EXIT_FAILURE;
+	}
+	// Directories of the list, checked against it lexed alone
+	struct pkgcache *base;
+	char *basedir;
+
+	if((base = base_cache(argv[1],&basedir)) == NULL ||
+			check_discovery(argv[1],base) || check_refresh(argv[1],base) ||
+			check_attach(argv[1]) || check_membudget(argv[1],base) ||
+			check_io(argv[1],base) || check_uring(argv[1],base)){
+		return EXIT_FAILURE;
+	}
+	free_package_cache(base);
+	remove_listdir(basedir);
+	// A pinned generation survives being replaced
+	struct pkgsnap *snap;
+	unsigned pin;
+
+	if((snap = pkgsnap_create(pc,0,&err)) == NULL){
+		fprintf(stderr,"Couldn't create snapshot (%s?)\n",strerror(err));
+		return EXIT_FAILURE;
+	}
+	if(pkgsnap_pin(snap,&pin) != pc || pkgsnap_publish(snap,colpc,&err) ||
+			pkgcache_count(pc) != pkgs || pkgsnap_reclaim(snap) != 1){
+		fprintf(stderr,"Bad snapshot publication\n");
+		return EXIT_FAILURE;
+	}
+	pkgsnap_unpin(snap,pin);
+	if(pkgsnap_reclaim(snap) || pkgsnap_pin(snap,&pin) != colpc){
+		fprintf(stderr,"Bad snapshot reclamation\n");
+		return EXIT_FAILURE;
+	}
+	pkgsnap_unpin(snap,pin);
+	pkgsnap_free(snap);
+
 	printf("Successfully parsed %s (%u package%s)\n",argv[1],
 			pkgs,pkgs == 1 ? "" : "s");
 	return EXIT_SUCCESS;